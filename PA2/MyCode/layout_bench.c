@@ -0,0 +1,307 @@
+// Barış Pome - CS307 - Operating Systems Course - Fall 2024-2025
+// This is layout_bench.c file
+// Microbenchmark of the cache line layout of the per-core state, for 1 thread up to the thread count:
+// 1. Completion counters: a packed int array against padded CoreCounter blocks
+// 2. Queues: the same deque operations on two layouts of the queue fields
+//    - packed: top, bottom, the buffer and the load counters on one line, queues next to each other
+//    - padded: grouped by writer like WorkBalancerQueue (top / bottom and buffer / load counters)
+//    Half of the threads own a queue and push and pop on it, the other half steal from the owners,
+//    reading the victim's load counter first like the steal loop does
+// Usage: ./bench_layout [operations per thread] [threads, default: the online CPUs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include "wbq.h"
+
+#define BENCH_SLOTS 1024 // Buffer of every benchmark deque, a power of two, never grows
+
+static long operations = 10000000;
+static int thread_count;
+static atomic_int ready;
+static atomic_int owners_done;
+
+static _Atomic int packed_counters[MAX_CORES];
+static struct
+{
+    _Alignas(CACHE_LINE) _Atomic int count;
+} padded_counters[MAX_CORES];
+
+// Queue fields without any alignment, two queues can share a line
+typedef struct PackedQueue
+{
+    _Atomic long top;
+    _Atomic long bottom;
+    _Atomic(Task *) *slots;
+    _Atomic long load;
+    _Atomic long stolen;
+} PackedQueue;
+
+// Queue fields on the lines of WorkBalancerQueue, grouped by who writes them
+typedef struct PaddedQueue
+{
+    _Alignas(CACHE_LINE) _Atomic long top;
+    _Alignas(CACHE_LINE) _Atomic long bottom;
+    _Atomic(Task *) *slots;
+    _Alignas(CACHE_LINE) _Atomic long load;
+    _Atomic long stolen;
+} PaddedQueue;
+
+// This struct points at the fields of one queue of either layout, the operations below only use it.
+// Each thread keeps its own copy on its stack.
+typedef struct QueueFields
+{
+    _Atomic long *top, *bottom, *load, *stolen;
+    _Atomic(Task *) *slots;
+} QueueFields;
+
+static PackedQueue packed_queues[MAX_CORES];
+static PaddedQueue padded_queues[MAX_CORES];
+static QueueFields (*queueFields)(int id);
+static Task tasks[MAX_CORES];
+
+static QueueFields packedFields(int id)
+{
+    PackedQueue *q = &packed_queues[id];
+    return (QueueFields){&q->top, &q->bottom, &q->load, &q->stolen, q->slots};
+}
+
+static QueueFields paddedFields(int id)
+{
+    PaddedQueue *q = &padded_queues[id];
+    return (QueueFields){&q->top, &q->bottom, &q->load, &q->stolen, q->slots};
+}
+
+// Owner push, like submitTask: a slot store, a release of bottom and the owner's load counter
+static void push(QueueFields *q, Task *task)
+{
+    long b = atomic_load_explicit(q->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(q->top, memory_order_acquire);
+    if (b - t >= BENCH_SLOTS)
+    {
+        return; // Full, the thieves are behind
+    }
+    atomic_store_explicit(&q->slots[b & (BENCH_SLOTS - 1)], task, memory_order_relaxed);
+    atomic_store_explicit(q->bottom, b + 1, memory_order_release);
+    atomic_store_explicit(q->load, atomic_load_explicit(q->load, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// Take the oldest task with a CAS on top, like takeTop; owners and thieves both use it
+static Task *take(QueueFields *q)
+{
+    long t = atomic_load_explicit(q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(q->bottom, memory_order_acquire);
+    if (b - t <= 0)
+    {
+        return NULL;
+    }
+    Task *task = atomic_load_explicit(&q->slots[t & (BENCH_SLOTS - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(q->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+    {
+        return NULL;
+    }
+    return task;
+}
+
+// Wait until every thread of the round is started, so they all run at the same time
+static void startTogether()
+{
+    atomic_fetch_add(&ready, 1);
+    while (atomic_load(&ready) < thread_count)
+    {
+        sched_yield();
+    }
+}
+
+// Plain increments like executeJob's, a relaxed load and store keeps the compiler from
+// folding the loop while adding no lock prefix
+static void *packedCounterThread(void *arg)
+{
+    int id = (int)(long)arg;
+    startTogether();
+    for (long i = 0; i < operations; i++)
+    {
+        int value = atomic_load_explicit(&packed_counters[id], memory_order_relaxed);
+        atomic_store_explicit(&packed_counters[id], value + 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+static void *paddedCounterThread(void *arg)
+{
+    int id = (int)(long)arg;
+    startTogether();
+    for (long i = 0; i < operations; i++)
+    {
+        int value = atomic_load_explicit(&padded_counters[id].count, memory_order_relaxed);
+        atomic_store_explicit(&padded_counters[id].count, value + 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+// Threads [0, owners) own a queue, the rest steal
+static int ownerCount()
+{
+    return (thread_count + 1) / 2;
+}
+
+// An operation is two pushes and one pop, the thieves take the surplus
+// Returns the nanoseconds the owner took for all of its operations
+static void *ownerThread(void *arg)
+{
+    int id = (int)(long)arg;
+    QueueFields q = queueFields(id);
+    struct timespec start, end;
+    startTogether();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < operations; i++)
+    {
+        push(&q, &tasks[id]);
+        push(&q, &tasks[id]);
+        if (take(&q) != NULL)
+        {
+            atomic_store_explicit(q.load, atomic_load_explicit(q.load, memory_order_relaxed) - 1,
+                                  memory_order_relaxed);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    atomic_fetch_add(&owners_done, 1);
+    return (void *)(long)((end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec));
+}
+
+// Steal from the owners in turn until they are all done, returns the number of tasks stolen
+static void *thiefThread(void *arg)
+{
+    int id = (int)(long)arg;
+    int owners = ownerCount();
+    long stolen = 0;
+    startTogether();
+    for (int victim = id % owners; atomic_load_explicit(&owners_done, memory_order_relaxed) < owners;
+         victim = (victim + 1) % owners)
+    {
+        QueueFields q = queueFields(victim);
+        if (atomic_load_explicit(q.load, memory_order_relaxed) - atomic_load_explicit(q.stolen, memory_order_relaxed) <= 0)
+        {
+            continue;
+        }
+        if (take(&q) != NULL)
+        {
+            atomic_fetch_add_explicit(q.stolen, 1, memory_order_relaxed);
+            stolen++;
+        }
+    }
+    return (void *)stolen;
+}
+
+// Run one round of counter threads and return the mean time of an increment in nanoseconds
+static double timeRound(void *(*body)(void *), int threads)
+{
+    pthread_t ids[MAX_CORES];
+    struct timespec start, end;
+
+    thread_count = threads;
+    atomic_store(&ready, 0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_create(&ids[i], NULL, body, (void *)(long)i);
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(ids[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    return ns / operations;
+}
+
+// Run one round of owners and thieves on a layout
+// Returns the mean owner time of an operation in nanoseconds, and the tasks stolen per microsecond of owner time
+static double timeQueueRound(QueueFields (*fields)(int id), int threads, double *steal_rate)
+{
+    pthread_t ids[MAX_CORES];
+    void *results[MAX_CORES];
+
+    queueFields = fields;
+    thread_count = threads;
+    atomic_store(&ready, 0);
+    atomic_store(&owners_done, 0);
+    int owners = ownerCount();
+    for (int i = 0; i < owners; i++)
+    {
+        QueueFields q = fields(i);
+        atomic_store(q.top, 0);
+        atomic_store(q.bottom, 0);
+        atomic_store(q.load, 0);
+        atomic_store(q.stolen, 0);
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_create(&ids[i], NULL, i < owners ? ownerThread : thiefThread, (void *)(long)i);
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(ids[i], &results[i]);
+    }
+
+    double owner_ns = 0, stolen = 0;
+    for (int i = 0; i < threads; i++)
+    {
+        if (i < owners)
+            owner_ns += (long)results[i];
+        else
+            stolen += (long)results[i];
+    }
+    *steal_rate = stolen / (owner_ns / owners / 1000.0);
+    return owner_ns / owners / operations;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+    {
+        operations = atol(argv[1]);
+    }
+    long max_threads = argc > 2 ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (operations < 1 || max_threads < 1)
+    {
+        fprintf(stderr, "Usage: %s [operations per thread] [threads]\n", argv[0]);
+        return 1;
+    }
+    if (max_threads > MAX_CORES)
+    {
+        max_threads = MAX_CORES;
+    }
+    for (int i = 0; i < MAX_CORES; i++)
+    {
+        packed_queues[i].slots = calloc(BENCH_SLOTS, sizeof(Task *));
+        padded_queues[i].slots = calloc(BENCH_SLOTS, sizeof(Task *));
+    }
+
+    // Doubling thread counts, then the thread count itself
+    printf("%-8s %14s %14s %16s %16s %18s %18s\n", "threads", "packed ns/inc", "padded ns/inc", "packed owner ns",
+           "padded owner ns", "packed steals/us", "padded steals/us");
+    for (int threads = 1; threads <= max_threads; threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2)
+    {
+        double packed = timeRound(packedCounterThread, threads);
+        double padded = timeRound(paddedCounterThread, threads);
+        double packed_steals, padded_steals;
+        double packed_owner = timeQueueRound(packedFields, threads, &packed_steals);
+        double padded_owner = timeQueueRound(paddedFields, threads, &padded_steals);
+        printf("%-8d %14.2f %14.2f %16.2f %16.2f %18.2f %18.2f\n", threads, packed, padded, packed_owner,
+               padded_owner, packed_steals, padded_steals);
+    }
+
+    for (int i = 0; i < MAX_CORES; i++)
+    {
+        free(packed_queues[i].slots);
+        free(padded_queues[i].slots);
+    }
+    return 0;
+}
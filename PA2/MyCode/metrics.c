@@ -0,0 +1,293 @@
+// Barış Pome - CS307 - Operating Systems Course - Fall 2024-2025
+// This is metrics.c file
+// Scheduler metrics:
+// - Every worker counts into its own CoreMetrics, no shared writes and no atomics in the scheduling loop
+// - Task latencies go into HDR style histograms, constant memory and O(1) recording
+// - Everything is merged once at shutdown and written as JSON and CSV
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "wbq.h"
+
+extern CoreCounter finished_jobs[MAX_CORES];
+extern int num_cores;
+extern WorkBalancerQueue **processor_queues;
+
+CoreMetrics core_metrics[MAX_CORES];
+
+static struct timespec metrics_epoch;
+static int metrics_virtual = 0;
+static long long virtual_now_us = 0; // Only written and read by the thread running the virtual mode
+
+void startMetrics(int virtual)
+{
+    metrics_virtual = virtual;
+    virtual_now_us = 0;
+    clock_gettime(CLOCK_MONOTONIC, &metrics_epoch);
+    memset(core_metrics, 0, sizeof(core_metrics));
+}
+
+void setVirtualTime(long long now_us)
+{
+    virtual_now_us = now_us;
+}
+
+long long metricsNow()
+{
+    if (metrics_virtual)
+    {
+        return virtual_now_us;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - metrics_epoch.tv_sec) * 1000000LL + (now.tv_nsec - metrics_epoch.tv_nsec) / 1000;
+}
+
+// Histograms
+// - Bucket 0..HIST_SUB_BUCKETS-1 hold exact values
+// - Above that, the highest set bit picks the power of two and the next HIST_SUB_BITS bits the bucket in it
+static int histogramIndex(long long value)
+{
+    if (value < HIST_SUB_BUCKETS)
+    {
+        return value < 0 ? 0 : (int)value;
+    }
+    int msb = 63 - __builtin_clzll((unsigned long long)value);
+    if (msb >= HIST_MAX_BITS)
+    {
+        return HIST_BUCKETS - 1;
+    }
+    int shift = msb - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_BUCKETS + (int)((value >> shift) & (HIST_SUB_BUCKETS - 1));
+}
+
+// Largest value recorded into the given bucket
+static long long histogramValue(int index)
+{
+    int group = index / HIST_SUB_BUCKETS, sub = index % HIST_SUB_BUCKETS;
+    if (group == 0)
+    {
+        return sub;
+    }
+    int shift = group - 1;
+    return ((long long)(HIST_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+static void histogramRecord(Histogram *h, long long value)
+{
+    if (value < 0)
+    {
+        value = 0;
+    }
+    h->buckets[histogramIndex(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value > h->max)
+    {
+        h->max = value;
+    }
+}
+
+static void histogramMerge(Histogram *into, const Histogram *h)
+{
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        into->buckets[i] += h->buckets[i];
+    }
+    into->count += h->count;
+    into->sum += h->sum;
+    if (h->max > into->max)
+    {
+        into->max = h->max;
+    }
+}
+
+// Value below which the given fraction of the recorded values fall, never above the exact maximum
+static long long histogramPercentile(const Histogram *h, double fraction)
+{
+    long rank = (long)(fraction * h->count + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    long seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += h->buckets[i];
+        if (seen >= rank)
+        {
+            long long value = histogramValue(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+// Task Lifecycle
+// - The timestamps live in the task, which only one core holds at a time
+// - Queueing delay sums every wait in a queue, including the ones after being requeued
+void taskArrived(Task *task, long long now_us)
+{
+    task->arrival_us = now_us;
+    task->ready_us = now_us;
+    task->first_run_us = -1;
+    task->waited_us = 0;
+}
+
+void taskStarted(int core, Task *task, long long now_us)
+{
+    CoreMetrics *m = &core_metrics[core];
+    if (task->first_run_us < 0)
+    {
+        task->first_run_us = now_us;
+        histogramRecord(&m->response, now_us - task->arrival_us);
+    }
+    task->waited_us += now_us - task->ready_us;
+    if (task->owner != processor_queues[core])
+    {
+        m->migrations++;
+        m->migration_cost_us += (long long)(migrationCost(task, processor_queues[core]) * 1000);
+    }
+}
+
+void taskRequeued(Task *task, long long now_us)
+{
+    task->ready_us = now_us;
+}
+
+void taskFinished(int core, Task *task, long long now_us)
+{
+    CoreMetrics *m = &core_metrics[core];
+    histogramRecord(&m->queueing, task->waited_us);
+    histogramRecord(&m->turnaround, now_us - task->arrival_us);
+}
+
+// Report
+static const double percentiles[] = {0.5, 0.9, 0.99, 0.999};
+static const char *percentile_names[] = {"p50", "p90", "p99", "p999"};
+#define PERCENTILE_COUNT 4
+
+static void mergeLatencies(Histogram merged[3])
+{
+    memset(merged, 0, 3 * sizeof(Histogram));
+    for (int i = 0; i < num_cores; i++)
+    {
+        histogramMerge(&merged[0], &core_metrics[i].queueing);
+        histogramMerge(&merged[1], &core_metrics[i].response);
+        histogramMerge(&merged[2], &core_metrics[i].turnaround);
+    }
+}
+
+static const char *latency_names[] = {"queueing", "response", "turnaround"};
+
+void printMigrationSummary(FILE *f)
+{
+    long migrations = 0;
+    long long cost_us = 0;
+    for (int i = 0; i < num_cores; i++)
+    {
+        migrations += core_metrics[i].migrations;
+        cost_us += core_metrics[i].migration_cost_us;
+    }
+    fprintf(f, "Migrations: %ld, work lost to cold caches: %.1f ms\n", migrations, cost_us / 1000.0);
+
+    long requeues = 0, continued = 0;
+    for (int i = 0; i < num_cores; i++)
+    {
+        requeues += core_metrics[i].requeues;
+        continued += core_metrics[i].continued;
+    }
+    fprintf(f, "Requeues: %ld, skipped by running to quantum: %ld\n", requeues, continued);
+}
+
+void printLatencySummary(FILE *f)
+{
+    static Histogram merged[3]; // Too large for the stack of a small thread
+    mergeLatencies(merged);
+    for (int k = 0; k < 3; k++)
+    {
+        fprintf(f, "%s%s p50/p99/max: %.1f/%.1f/%.1f ms", k ? ", " : "Latency ", latency_names[k],
+                histogramPercentile(&merged[k], 0.5) / 1000.0, histogramPercentile(&merged[k], 0.99) / 1000.0,
+                merged[k].max / 1000.0);
+    }
+    fprintf(f, "\n");
+}
+
+static void writeLatencyJson(FILE *f, const char *name, const Histogram *h, int last)
+{
+    fprintf(f, "    \"%s\": {\"count\": %ld, \"mean_ms\": %.3f", name, h->count,
+            h->count ? h->sum / 1000.0 / h->count : 0.0);
+    for (int p = 0; p < PERCENTILE_COUNT; p++)
+    {
+        fprintf(f, ", \"%s_ms\": %.3f", percentile_names[p], histogramPercentile(h, percentiles[p]) / 1000.0);
+    }
+    fprintf(f, ", \"max_ms\": %.3f}%s\n", h->max / 1000.0, last ? "" : ",");
+}
+
+int writeMetrics(const char *prefix, double makespan_ms)
+{
+    static Histogram merged[3];
+    mergeLatencies(merged);
+    char path[4096];
+
+    snprintf(path, sizeof(path), "%s.json", prefix);
+    FILE *json = fopen(path, "w");
+    if (json == NULL)
+    {
+        return 0;
+    }
+    fprintf(json, "{\n  \"makespan_ms\": %.3f,\n  \"cores\": [\n", makespan_ms);
+    for (int i = 0; i < num_cores; i++)
+    {
+        CoreMetrics *m = &core_metrics[i];
+        fprintf(json,
+                "    {\"core\": %d, \"busy_ms\": %.3f, \"idle_ms\": %.3f, \"utilization\": %.4f, "
+                "\"tasks_finished\": %d, \"slices\": %ld, \"local_fetches\": %ld, \"steal_attempts\": %ld, "
+                "\"steals\": %ld, \"migrations\": %ld, \"migration_cost_ms\": %.3f, \"requeues\": %ld, \"continued\": %ld}%s\n",
+                i, m->busy_us / 1000.0, m->idle_us / 1000.0, makespan_ms > 0 ? m->busy_us / 1000.0 / makespan_ms : 0.0,
+                finished_jobs[i].count, finished_jobs[i].slices, m->local_fetches, m->steal_attempts, m->steals,
+                m->migrations, m->migration_cost_us / 1000.0, m->requeues, m->continued, i + 1 < num_cores ? "," : "");
+    }
+    fprintf(json, "  ],\n  \"latency\": {\n");
+    for (int k = 0; k < 3; k++)
+    {
+        writeLatencyJson(json, latency_names[k], &merged[k], k == 2);
+    }
+    fprintf(json, "  }\n}\n");
+    int ok = fclose(json) == 0;
+
+    // Two tables: one row per core, then one row per latency
+    snprintf(path, sizeof(path), "%s.csv", prefix);
+    FILE *csv = fopen(path, "w");
+    if (csv == NULL)
+    {
+        return 0;
+    }
+    fprintf(csv, "core,busy_ms,idle_ms,utilization,tasks_finished,slices,local_fetches,steal_attempts,steals,migrations,migration_cost_ms,requeues,continued\n");
+    for (int i = 0; i < num_cores; i++)
+    {
+        CoreMetrics *m = &core_metrics[i];
+        fprintf(csv, "%d,%.3f,%.3f,%.4f,%d,%ld,%ld,%ld,%ld,%ld,%.3f,%ld,%ld\n", i, m->busy_us / 1000.0, m->idle_us / 1000.0,
+                makespan_ms > 0 ? m->busy_us / 1000.0 / makespan_ms : 0.0, finished_jobs[i].count,
+                finished_jobs[i].slices, m->local_fetches, m->steal_attempts, m->steals, m->migrations,
+                m->migration_cost_us / 1000.0, m->requeues, m->continued);
+    }
+    fprintf(csv, "\nlatency,count,mean_ms");
+    for (int p = 0; p < PERCENTILE_COUNT; p++)
+    {
+        fprintf(csv, ",%s_ms", percentile_names[p]);
+    }
+    fprintf(csv, ",max_ms\n");
+    for (int k = 0; k < 3; k++)
+    {
+        const Histogram *h = &merged[k];
+        fprintf(csv, "%s,%ld,%.3f", latency_names[k], h->count, h->count ? h->sum / 1000.0 / h->count : 0.0);
+        for (int p = 0; p < PERCENTILE_COUNT; p++)
+        {
+            fprintf(csv, ",%.3f", histogramPercentile(h, percentiles[p]) / 1000.0);
+        }
+        fprintf(csv, ",%.3f\n", h->max / 1000.0);
+    }
+    return fclose(csv) == 0 && ok;
+}
@@ -0,0 +1,423 @@
+// Barış Pome - CS307 - Operating Systems Course - Fall 2024-2025
+// This is queue_bench.c file
+// Microbenchmark of the queue operations under contention, without the simulator's sleeps:
+// - Owner threads submit to and fetch from their own queue, thief threads steal from the owners' queues
+// - Five mixes: producer-heavy, balanced, steal-heavy, balanced with owners submitting in batches like
+//   drainInjected (an operation is one task moved, a batch of b tasks counts as b operations), and steal-half where
+//   thieves own a queue, run what they stole from it and steal half of a victim when it is empty
+//   (an operation is one fetch or steal attempt of a thief, thief latencies are those of the half steals)
+// - Every backend runs every mix: the lock-free WorkBalancerQueue and the original mutex list (wbq_locked.c)
+// - Reports the throughput and the latency percentiles of owner and thief operations
+// Usage: ./bench_queue [-o owners] [-t thieves] [-n operations per owner] [-b batch size]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sched.h>
+#include "wbq.h"
+#include "wbq_locked.h"
+
+#define SAMPLE_EVERY 32 // One operation in SAMPLE_EVERY is timed on its own
+
+// This struct is the part of a queue implementation the benchmark drives.
+typedef struct QueueBackend
+{
+    const char *name;
+    void *(*create)();
+    void (*destroy)(void *q);
+    void (*submit)(void *q, Task *task);
+    Task *(*fetch)(void *q);
+    Task *(*steal)(void *q);
+    void (*submit_batch)(void *q, Task **tasks, int n);
+    Task *(*steal_half)(void *q, void *my_queue);
+} QueueBackend;
+
+static void *createLockFree()
+{
+    WorkBalancerQueue *q = aligned_alloc(CACHE_LINE, sizeof(WorkBalancerQueue));
+    WorkBalancerQueue_Init(q);
+    return q;
+}
+
+static void destroyLockFree(void *q)
+{
+    WorkBalancerQueue_Destroy(q);
+    free(q);
+}
+
+static void submitLockFree(void *q, Task *task)
+{
+    submitTask(q, task);
+}
+
+static Task *fetchLockFree(void *q)
+{
+    return fetchTask(q);
+}
+
+static Task *stealLockFree(void *q)
+{
+    return fetchTaskFromOthers(q);
+}
+
+static void submitBatchLockFree(void *q, Task **tasks, int n)
+{
+    submitTasks(q, tasks, n);
+}
+
+static Task *stealHalfLockFree(void *q, void *my_queue)
+{
+    return fetchHalfFromOthers(q, my_queue);
+}
+
+static void *createLocked()
+{
+    LockedQueue *q = malloc(sizeof(LockedQueue));
+    LockedQueue_Init(q);
+    return q;
+}
+
+static void destroyLocked(void *q)
+{
+    LockedQueue_Destroy(q);
+    free(q);
+}
+
+static void submitLocked(void *q, Task *task)
+{
+    lockedSubmitTask(q, task);
+}
+
+static Task *fetchLocked(void *q)
+{
+    return lockedFetchTask(q);
+}
+
+static Task *stealLocked(void *q)
+{
+    return lockedFetchTaskFromOthers(q);
+}
+
+static void submitBatchLocked(void *q, Task **tasks, int n)
+{
+    lockedSubmitTasks(q, tasks, n);
+}
+
+static Task *stealHalfLocked(void *q, void *my_queue)
+{
+    return lockedFetchHalfFromOthers(q, my_queue);
+}
+
+static const QueueBackend backends[] = {
+    {"lock-free", createLockFree, destroyLockFree, submitLockFree, fetchLockFree, stealLockFree, submitBatchLockFree,
+     stealHalfLockFree},
+    {"mutex", createLocked, destroyLocked, submitLocked, fetchLocked, stealLocked, submitBatchLocked, stealHalfLocked},
+};
+
+// This struct is a workload: how often owners submit and how busy the thieves are.
+typedef struct Mix
+{
+    const char *name;
+    int submit_percent;    // Owner operations that are submits, the rest are fetches
+    int thief_ops_divisor; // A thief does operations / thief_ops_divisor steal attempts
+    int batched;           // Owners submit batch_size tasks per call, fetches stay single
+    int half;              // Thieves steal half of a victim into their own queue and run it from there
+} Mix;
+
+static const Mix mixes[] = {
+    {"producer-heavy", 75, 8, 0, 0},
+    {"balanced", 50, 2, 0, 0},
+    {"steal-heavy", 90, 1, 0, 0},
+    {"submit-batch", 50, 2, 1, 0},
+    {"steal-half", 90, 1, 0, 1},
+};
+
+#define MAX_BATCH 256
+
+static int owners = 4, thieves = 4, batch_size = 8;
+static long operations = 1000000;
+static const QueueBackend *backend;
+static const Mix *mix;
+static void *queues[2 * MAX_CORES]; // Owners' queues, then the thieves' own queues for the steal-half mix
+static Task tasks[MAX_CORES];
+static atomic_int ready;
+
+// This struct is the latency sample of one thread.
+typedef struct Samples
+{
+    long *ns;
+    long count;
+} Samples;
+
+static Samples samples[2 * MAX_CORES];
+
+// Wait until every thread of the round is started, so they all run at the same time
+static void startTogether()
+{
+    atomic_fetch_add(&ready, 1);
+    while (atomic_load(&ready) < owners + thieves)
+    {
+        sched_yield();
+    }
+}
+
+static long nowNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+// Per-thread fast PRNG (xorshift64*)
+static unsigned long long nextRandom(unsigned long long *rng)
+{
+    *rng ^= *rng >> 12;
+    *rng ^= *rng << 25;
+    *rng ^= *rng >> 27;
+    return *rng * 2685821657736338717ULL;
+}
+
+// Owner submitting in batches of batch_size tasks and fetching one task per call
+// - A call is a batch with the odds that keep submit_percent of the tasks moved submits
+static void ownerBatchLoop(int id, unsigned long long *rng, Samples *s, void *q)
+{
+    Task *batch[MAX_BATCH];
+    for (int i = 0; i < batch_size; i++)
+    {
+        batch[i] = &tasks[id];
+    }
+    long submit_weight = mix->submit_percent, fetch_weight = (long)(100 - mix->submit_percent) * batch_size;
+    long moved = 0;
+    for (long i = 0; moved < operations; i++)
+    {
+        int submit = (long)(nextRandom(rng) % (submit_weight + fetch_weight)) < submit_weight;
+        int timed = i % SAMPLE_EVERY == 0;
+        long start = timed ? nowNs() : 0;
+        if (submit)
+            backend->submit_batch(q, batch, batch_size);
+        else
+            backend->fetch(q);
+        if (timed)
+            s->ns[s->count++] = nowNs() - start;
+        moved += submit ? batch_size : 1;
+    }
+}
+
+static void *ownerThread(void *arg)
+{
+    int id = (int)(long)arg;
+    unsigned long long rng = 0x9E3779B97F4A7C15ULL * (id + 1);
+    Samples *s = &samples[id];
+    void *q = queues[id];
+    startTogether();
+    if (mix->batched)
+    {
+        ownerBatchLoop(id, &rng, s, q);
+        return NULL;
+    }
+    for (long i = 0; i < operations; i++)
+    {
+        int submit = (int)(nextRandom(&rng) % 100) < mix->submit_percent;
+        if (i % SAMPLE_EVERY == 0)
+        {
+            long start = nowNs();
+            if (submit)
+                backend->submit(q, &tasks[id]);
+            else
+                backend->fetch(q);
+            s->ns[s->count++] = nowNs() - start;
+        }
+        else if (submit)
+        {
+            backend->submit(q, &tasks[id]);
+        }
+        else
+        {
+            backend->fetch(q);
+        }
+    }
+    return NULL;
+}
+
+// Thief of the steal-half mix, a worker without tasks of its own: it runs the stolen tasks from its own queue
+// and steals again once that is empty. Only the half steals are timed.
+static void thiefHalfLoop(int id, Samples *s, long attempts)
+{
+    void *my_queue = queues[owners + id];
+    long steals = 0;
+    for (long i = 0; i < attempts; i++)
+    {
+        if (backend->fetch(my_queue) != NULL)
+        {
+            continue;
+        }
+        void *victim = queues[(id + i) % owners];
+        if (steals++ % SAMPLE_EVERY == 0)
+        {
+            long start = nowNs();
+            backend->steal_half(victim, my_queue);
+            s->ns[s->count++] = nowNs() - start;
+        }
+        else
+        {
+            backend->steal_half(victim, my_queue);
+        }
+    }
+}
+
+static void *thiefThread(void *arg)
+{
+    int id = (int)(long)arg;
+    Samples *s = &samples[owners + id];
+    long attempts = operations / mix->thief_ops_divisor;
+    startTogether();
+    if (mix->half)
+    {
+        thiefHalfLoop(id, s, attempts);
+        return NULL;
+    }
+    for (long i = 0; i < attempts; i++)
+    {
+        void *victim = queues[(id + i) % owners];
+        if (i % SAMPLE_EVERY == 0)
+        {
+            long start = nowNs();
+            backend->steal(victim);
+            s->ns[s->count++] = nowNs() - start;
+        }
+        else
+        {
+            backend->steal(victim);
+        }
+    }
+    return NULL;
+}
+
+static int compareLong(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+// Merge the samples of threads [from, to) and return them sorted, count in *count
+static long *mergeSamples(int from, int to, long *count)
+{
+    long total = 0;
+    for (int i = from; i < to; i++)
+        total += samples[i].count;
+    long *all = malloc((total + 1) * sizeof(long));
+    long k = 0;
+    for (int i = from; i < to; i++)
+    {
+        memcpy(all + k, samples[i].ns, samples[i].count * sizeof(long));
+        k += samples[i].count;
+    }
+    qsort(all, total, sizeof(long), compareLong);
+    *count = total;
+    return all;
+}
+
+static long percentile(const long *sorted, long count, double fraction)
+{
+    if (count == 0)
+        return 0;
+    long rank = (long)(fraction * (count - 1) + 0.5);
+    return sorted[rank];
+}
+
+// Run one backend on one mix and print its row
+static void runRound()
+{
+    pthread_t ids[2 * MAX_CORES];
+    for (int i = 0; i < owners; i++)
+    {
+        queues[i] = backend->create();
+        for (int j = 0; j < 16; j++) // Something to steal from the start
+            backend->submit(queues[i], &tasks[i]);
+    }
+    for (int i = 0; mix->half && i < thieves; i++)
+    {
+        queues[owners + i] = backend->create();
+    }
+    for (int i = 0; i < owners + thieves; i++)
+    {
+        samples[i].count = 0;
+    }
+
+    atomic_store(&ready, 0);
+    long start = nowNs();
+    for (int i = 0; i < owners; i++)
+        pthread_create(&ids[i], NULL, ownerThread, (void *)(long)i);
+    for (int i = 0; i < thieves; i++)
+        pthread_create(&ids[owners + i], NULL, thiefThread, (void *)(long)i);
+    for (int i = 0; i < owners + thieves; i++)
+        pthread_join(ids[i], NULL);
+    double seconds = (nowNs() - start) / 1e9;
+
+    long total_ops = owners * operations + thieves * (operations / mix->thief_ops_divisor);
+    long owner_count, thief_count;
+    long *owner_ns = mergeSamples(0, owners, &owner_count);
+    long *thief_ns = mergeSamples(owners, owners + thieves, &thief_count);
+    printf("%-15s %-10s %8.2f %8ld %8ld %8ld %8ld %8ld %8ld\n", mix->name, backend->name, total_ops / seconds / 1e6,
+           percentile(owner_ns, owner_count, 0.5), percentile(owner_ns, owner_count, 0.99),
+           percentile(owner_ns, owner_count, 0.999), percentile(thief_ns, thief_count, 0.5),
+           percentile(thief_ns, thief_count, 0.99), percentile(thief_ns, thief_count, 0.999));
+    free(owner_ns);
+    free(thief_ns);
+
+    for (int i = 0; i < owners; i++)
+        backend->destroy(queues[i]);
+    for (int i = 0; mix->half && i < thieves; i++)
+        backend->destroy(queues[owners + i]);
+}
+
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            owners = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            thieves = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            operations = atol(argv[++i]);
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            batch_size = atoi(argv[++i]);
+        else
+            owners = 0; // Reported below
+    }
+    if (owners < 1 || owners > MAX_CORES || thieves < 0 || thieves > MAX_CORES || operations < 1 || batch_size < 1 ||
+        batch_size > MAX_BATCH)
+    {
+        fprintf(stderr, "Usage: %s [-o owners (1-%d)] [-t thieves (0-%d)] [-n operations per owner] [-b batch (1-%d)]\n",
+                argv[0], MAX_CORES, MAX_CORES, MAX_BATCH);
+        return 1;
+    }
+    for (int i = 0; i < owners + thieves; i++)
+    {
+        samples[i].ns = malloc((operations / SAMPLE_EVERY + 1) * sizeof(long));
+    }
+
+    printf("%d owners, %d thieves, %ld operations per owner, batches of %d, latency in ns per call (1 in %d timed)\n",
+           owners, thieves, operations, batch_size, SAMPLE_EVERY);
+    printf("%-15s %-10s %8s %8s %8s %8s %8s %8s %8s\n", "mix", "backend", "Mops/s", "own p50", "own p99", "own p999",
+           "thf p50", "thf p99", "thf p999");
+    for (int m = 0; m < (int)(sizeof(mixes) / sizeof(mixes[0])); m++)
+    {
+        mix = &mixes[m];
+        for (int b = 0; b < (int)(sizeof(backends) / sizeof(backends[0])); b++)
+        {
+            backend = &backends[b];
+            runRound();
+        }
+    }
+
+    for (int i = 0; i < owners + thieves; i++)
+    {
+        free(samples[i].ns);
+    }
+    return 0;
+}
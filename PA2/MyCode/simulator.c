@@ -1,6 +1,7 @@
 // Barış Pome - CS307 - Operating Systems Course - Fall 2024-2025
 // This is simulator.c file
 
+#define _GNU_SOURCE // pthread_setaffinity_np
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,38 +9,69 @@
 #include <unistd.h>
 #include <time.h>
 #include <limits.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include "constants.h"
 #include "wbq.h"
 
-extern int stop_threads;
-extern int finished_jobs[NUM_CORES];
+extern atomic_int stop_threads;
+extern CoreCounter finished_jobs[MAX_CORES];
+extern int num_cores;
 extern WorkBalancerQueue **processor_queues;
+extern CoreMetrics core_metrics[MAX_CORES];
 
 // Dynamic Watermark Calculation
 // Performance considerations:
 // - Adaptive load balancing: Adjusts thresholds based on system state
 // - System-wide optimization: Considers all queue states
-// - Trade-off: Additional overhead for better load distribution
+// - Low overhead: The system state is summarized periodically, not on every iteration
 
-// Calculate watermarks based on the current state of all queues
+// Global load summary
+// - Every queue keeps its size in a load counter on its own line (updated on submit, fetch and steal)
+// - One worker at a time sums the counters and publishes the watermarks as a single word,
+//   along with the largest queue and the set of queues above the high watermark
+// - Readers do one atomic load of a line that only changes when a new summary is published,
+//   nobody polls the other queues
+#define LOAD_PUBLISH_PERIOD 4 // Loop iterations of a worker between two publications
+
+static _Atomic unsigned long long load_summary = (4ULL << 32) | 2; // High watermark in the upper half, low in the lower
+static _Atomic int largest_queue = 0;                               // Core with the most tasks at the last publication
+static _Atomic unsigned long long stealable_queues = 0;             // Bit i is set if queue i was above the high watermark
+static atomic_flag load_publishing = ATOMIC_FLAG_INIT;
+static int virtual_mode = 0;            // Set by runVirtual, parking and wakeups are simulated then
+static long vt_load_changes = 0;        // Load counter changes in virtual time, see countLoadChanges
+static long vt_summarized_changes = -1; // vt_load_changes at the last publication
+
+// Publish the watermarks based on the current state of all queues
 // The reason why i implemented this in the simulator is because i want to have the ability to change the watermarks
 // based on the current state of the queues. This causes use maximum number of cores and arrangement of the queues.
-// This causes use maximum number of cores and arrangement of the queues.
-void calculateWatermarks(int my_id, int *high_watermark, int *low_watermark)
+// - Called with load_publishing held, returns the stealable set it published
+static unsigned long long computeLoadSummary()
 {
-    int total_tasks = 0;
-    int max_size = 0;
+    // In virtual time nothing runs between the events, unchanged counters give the published summary again
+    if (virtual_mode && vt_load_changes == vt_summarized_changes)
+    {
+        return atomic_load_explicit(&stealable_queues, memory_order_relaxed);
+    }
+    vt_summarized_changes = vt_load_changes;
 
     // System-wide load analysis
-    // - O(n) operation where n is number of cores
+    // - O(n) operation where n is number of cores, amortized over LOAD_PUBLISH_PERIOD iterations
     // - Provides global load perspective
-    for (int i = 0; i < NUM_CORES; i++)
+    // - Reads one load counter per core, never the top and bottom lines the takers contend on
+    int sizes[MAX_CORES];
+    int total_tasks = 0;
+    int max_size = -1, max_id = 0;
+    for (int i = 0; i < num_cores; i++)
     {
-        int current_size = getQueueSize(processor_queues[i]);
+        int current_size = getQueueLoad(processor_queues[i]);
+        sizes[i] = current_size;
         total_tasks += current_size;
         if (current_size > max_size)
         {
             max_size = current_size;
+            max_id = i;
         }
     }
 
@@ -48,18 +80,461 @@ void calculateWatermarks(int my_id, int *high_watermark, int *low_watermark)
     // - Prevents unnecessary work stealing
     // - Optimizes resource utilization
     // Calculate average load
-    float avg_load = (float)total_tasks / NUM_CORES;
+    float avg_load = (float)total_tasks / num_cores;
     // Set watermarks based on system state
-    *high_watermark = (int)(avg_load * 1.5); // 50% more than average
-    *low_watermark = (int)(avg_load * 0.5);  // 50% less than average
+    unsigned long long high_watermark = (unsigned long long)(avg_load * 1.5); // 50% more than average
+    unsigned long long low_watermark = (unsigned long long)(avg_load * 0.5);  // 50% less than average
 
     // Minimum threshold enforcement
     // - Ensures basic load balancing even with light loads
     // - Prevents excessive stealing for small workloads
-    if (*high_watermark < 4)
-        *high_watermark = 4;
-    if (*low_watermark < 2)
-        *low_watermark = 2;
+    if (high_watermark < 4)
+        high_watermark = 4;
+    if (low_watermark < 2)
+        low_watermark = 2;
+
+    // Queues worth stealing from under the new watermarks
+    unsigned long long stealable = 0;
+    for (int i = 0; i < num_cores; i++)
+    {
+        if (sizes[i] > (int)high_watermark)
+            stealable |= 1ULL << i;
+    }
+
+    atomic_store_explicit(&load_summary, (high_watermark << 32) | low_watermark, memory_order_relaxed);
+    atomic_store_explicit(&largest_queue, max_id, memory_order_relaxed);
+    atomic_store_explicit(&stealable_queues, stealable, memory_order_relaxed);
+    return stealable;
+}
+
+// Periodic publication, skipped if another worker is publishing right now
+static void publishLoadSummary()
+{
+    if (atomic_flag_test_and_set_explicit(&load_publishing, memory_order_acquire))
+    {
+        return;
+    }
+    computeLoadSummary();
+    atomic_flag_clear_explicit(&load_publishing, memory_order_release);
+}
+
+// Publication that counts everything the caller did before it
+// - A publication in flight may have read the counters before the caller's last submit or announce,
+//   so this one waits for it to end and publishes again instead of skipping
+// - Returns the stealable set computed by this call, a later publication cannot make the caller miss it
+static unsigned long long awaitLoadSummary()
+{
+    atomic_thread_fence(memory_order_seq_cst); // Order the caller's submit or announce before the counters are read
+    while (atomic_flag_test_and_set_explicit(&load_publishing, memory_order_acquire))
+    {
+        sched_yield(); // The publisher only sums num_cores counters
+    }
+    unsigned long long stealable = computeLoadSummary();
+    atomic_flag_clear_explicit(&load_publishing, memory_order_release);
+    return stealable;
+}
+
+// Calculate watermarks based on the last published summary
+// - O(1): one atomic load, no access to other cores' queues
+void calculateWatermarks(int my_id, int *high_watermark, int *low_watermark)
+{
+    unsigned long long summary = atomic_load_explicit(&load_summary, memory_order_relaxed);
+    *high_watermark = (int)(summary >> 32);
+    *low_watermark = (int)(summary & 0xFFFFFFFF);
+}
+
+// Queues other than my_id's that were above the high watermark at the last publication
+static unsigned long long stealableQueues(int my_id)
+{
+    return atomic_load_explicit(&stealable_queues, memory_order_relaxed) & ~(1ULL << my_id);
+}
+
+// Idle Parking
+// Design considerations:
+// - An idle worker sleeps on its own condition variable instead of polling
+// - Targeted wakeups: a submit that leaves a queue above the high watermark wakes exactly one parked worker
+// - No lost wakeups: a worker announces itself in parked_workers, then computes a load summary of its own
+//   for its last check for work; a waker publishes its task before reading parked_workers. Either the
+//   waker sees the announce, or the worker's summary counts the task
+// - Watermarks also move without any submit, so a parked worker rechecks after PARK_TIMEOUT_MS
+#define PARK_TIMEOUT_MS 50
+
+typedef struct ParkingSlot
+{
+    _Alignas(CACHE_LINE) pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int woken; // Set by a waker, cleared by the worker
+} ParkingSlot;
+
+static ParkingSlot parking_slots[MAX_CORES];
+static _Atomic unsigned long long parked_workers = 0; // Bit i is set while worker i is parked
+
+static void virtualWake(WorkBalancerQueue *q);
+static void virtualWakeCore(int core);
+static int virtualThiefWaiting(int my_id);
+
+// Check for work a parked worker could take: its own tasks or a queue worth stealing from
+// - The other queues are only seen through stealable, the set returned by the caller's awaitLoadSummary
+static int workAvailable(int my_id, unsigned long long stealable)
+{
+    if (getQueueSize(processor_queues[my_id]) > 0 || atomic_load(&processor_queues[my_id]->inbox) != NULL)
+    {
+        return 1;
+    }
+    return (stealable & ~(1ULL << my_id)) != 0;
+}
+
+// Park until woken, stopped or the timeout passes
+static void parkWorker(int my_id)
+{
+    ParkingSlot *slot = &parking_slots[my_id];
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += PARK_TIMEOUT_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    long long parked_at = metricsNow();
+    logParked(my_id, 1);
+
+    pthread_mutex_lock(&slot->lock);
+    atomic_fetch_or(&parked_workers, 1ULL << my_id); // Announce, then check once more
+    if (!workAvailable(my_id, awaitLoadSummary()))   // Own summary, counts a submit whose waker missed the announce
+    {
+        while (!slot->woken && !atomic_load(&stop_threads))
+        {
+            if (pthread_cond_timedwait(&slot->cond, &slot->lock, &deadline) == ETIMEDOUT)
+                break;
+        }
+    }
+    slot->woken = 0;
+    atomic_fetch_and(&parked_workers, ~(1ULL << my_id));
+    pthread_mutex_unlock(&slot->lock);
+    logParked(my_id, 0);
+    core_metrics[my_id].idle_us += metricsNow() - parked_at;
+}
+
+void wakeIdleWorker(WorkBalancerQueue *q)
+{
+    if (virtual_mode)
+    {
+        virtualWake(q);
+        return;
+    }
+    atomic_thread_fence(memory_order_seq_cst); // Order the submit before reading parked_workers
+    unsigned long long parked = atomic_load(&parked_workers);
+    if (parked == 0)
+    {
+        return;
+    }
+
+    int high_watermark, low_watermark;
+    calculateWatermarks(-1, &high_watermark, &low_watermark);
+    if (getQueueSize(q) <= high_watermark)
+    {
+        return;
+    }
+    awaitLoadSummary(); // The woken worker finds q in the stealable set, even if a publication was in flight
+
+    ParkingSlot *slot = &parking_slots[__builtin_ctzll(parked)]; // Wake a single worker
+    pthread_mutex_lock(&slot->lock);
+    slot->woken = 1;
+    pthread_cond_signal(&slot->cond);
+    pthread_mutex_unlock(&slot->lock);
+}
+
+// Wake a core that was handed tasks through its inbox, if it is parked
+static void wakeOwner(int core)
+{
+    if (virtual_mode)
+    {
+        virtualWakeCore(core);
+        return;
+    }
+
+    // The inject CAS orders the tasks before this read, see parkWorker for the other side
+    if (atomic_load(&parked_workers) & (1ULL << core))
+    {
+        ParkingSlot *slot = &parking_slots[core];
+        pthread_mutex_lock(&slot->lock);
+        slot->woken = 1;
+        pthread_cond_signal(&slot->cond);
+        pthread_mutex_unlock(&slot->lock);
+    }
+}
+
+void deliverTasks(int core, Task **tasks, int n)
+{
+    long long now = metricsNow();
+    for (int i = 0; i < n; i++)
+    {
+        taskArrived(tasks[i], now);
+        injectTask(processor_queues[core], tasks[i]);
+    }
+    wakeOwner(core);
+}
+
+void wakeAllWorkers()
+{
+    for (int i = 0; i < num_cores; i++)
+    {
+        pthread_mutex_lock(&parking_slots[i].lock);
+        parking_slots[i].woken = 1;
+        pthread_cond_signal(&parking_slots[i].cond);
+        pthread_mutex_unlock(&parking_slots[i].lock);
+    }
+}
+
+// Completion Latch
+// - Counts the registered jobs down as they finish
+// - The last job wakes the main thread right away, no polling interval
+static _Atomic long jobs_outstanding = 0;
+static pthread_mutex_t latch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t latch_cond = PTHREAD_COND_INITIALIZER;
+
+void jobsRegistered(int n)
+{
+    atomic_fetch_add(&jobs_outstanding, n);
+}
+
+void jobFinished()
+{
+    if (atomic_fetch_sub(&jobs_outstanding, 1) == 1) // This was the last job
+    {
+        pthread_mutex_lock(&latch_lock);
+        pthread_cond_broadcast(&latch_cond);
+        pthread_mutex_unlock(&latch_lock);
+    }
+}
+
+void waitForAllJobs()
+{
+    pthread_mutex_lock(&latch_lock);
+    while (atomic_load(&jobs_outstanding) > 0)
+    {
+        pthread_cond_wait(&latch_cond, &latch_lock);
+    }
+    pthread_mutex_unlock(&latch_lock);
+}
+
+// Topology and Placement
+// - Worker i runs on worker_cpu[i]; the allowed CPUs are taken in last level cache order,
+//   so neighbouring workers share an LLC
+// - steal_order[i] lists the other workers, the ones sharing worker i's LLC first
+// - Queues are allocated and first touched by a thread already running on the worker's CPU
+static int worker_cpu[MAX_CORES];
+static int worker_llc[MAX_CORES];
+static int steal_order[MAX_CORES][MAX_CORES];
+
+// Read the LLC id of a CPU from sysfs: the first CPU sharing its highest level cache
+static int readLlcId(int cpu)
+{
+    char path[128], list[256];
+    for (int index = 9; index >= 0; index--)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+        FILE *f = fopen(path, "r");
+        if (f == NULL)
+            continue;
+        int first = cpu;
+        if (fgets(list, sizeof(list), f))
+            first = atoi(list);
+        fclose(f);
+        return first;
+    }
+    return 0; // No cache information, treat all CPUs as one LLC
+}
+
+static void detectTopology()
+{
+    static int cpus[CPU_SETSIZE], llcs[CPU_SETSIZE];
+    int n = 0;
+    cpu_set_t allowed;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                // Insert sorted by LLC, keeping CPU order within an LLC
+                int llc = readLlcId(cpu), j = n++;
+                for (; j > 0 && llcs[j - 1] > llc; j--)
+                {
+                    cpus[j] = cpus[j - 1];
+                    llcs[j] = llcs[j - 1];
+                }
+                cpus[j] = cpu;
+                llcs[j] = llc;
+            }
+        }
+    }
+    if (n == 0) // Affinity unknown, run unpinned on one LLC
+    {
+        cpus[0] = -1;
+        llcs[0] = 0;
+        n = 1;
+    }
+
+    for (int i = 0; i < num_cores; i++) // More workers than CPUs wrap around
+    {
+        worker_cpu[i] = cpus[i % n];
+        worker_llc[i] = llcs[i % n];
+    }
+    for (int i = 0; i < num_cores; i++)
+    {
+        int k = 0;
+        for (int same = 1; same >= 0; same--) // Same LLC first, then remote, each from the next worker on
+        {
+            for (int d = 1; d < num_cores; d++)
+            {
+                int j = (i + d) % num_cores;
+                if ((worker_llc[j] == worker_llc[i]) == same)
+                    steal_order[i][k++] = j;
+            }
+        }
+    }
+}
+
+// Pin the calling thread, best effort: placement only affects performance
+static void pinToCpu(int cpu)
+{
+    if (cpu < 0)
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+// Allocate a worker's queue and task pool from its own CPU, so the first touch places the memory there
+static void *placeQueue(void *arg)
+{
+    int id = (int)(long)arg;
+    pinToCpu(worker_cpu[id]);
+    processor_queues[id] = aligned_alloc(CACHE_LINE, sizeof(WorkBalancerQueue)); // Line-aligned, see wbq.h
+    WorkBalancerQueue_Init(processor_queues[id]);                                // Initialize WBQ for each core
+    placeTaskPool(id);                                                           // The loader fills these tasks in
+    return NULL;
+}
+
+// Victim Selection
+// Design considerations:
+// - Pluggable: a policy names the victim of each steal attempt, at most num_cores - 1 attempts per steal
+// - local: same-LLC neighbours first (steal_order), the default
+// - neighbor: round robin from the next core on, ignoring topology
+// - random: a uniformly random other core, spreads idle cores over all victims
+// - largest: the largest queue of the last load summary first, then the local order
+// - Every thief counts its steals per victim in its own row, so hotspots show up without shared writes
+typedef int (*VictimPolicy)(int my_id, int attempt, unsigned long long *rng);
+
+typedef struct StealCounts
+{
+    _Alignas(CACHE_LINE) long from[MAX_CORES]; // Steals of one thief, by victim
+} StealCounts;
+
+static StealCounts steal_counts[MAX_CORES];
+
+// Per-thread fast PRNG (xorshift64*)
+static unsigned long long nextRandom(unsigned long long *rng)
+{
+    *rng ^= *rng >> 12;
+    *rng ^= *rng << 25;
+    *rng ^= *rng >> 27;
+    return *rng * 2685821657736338717ULL;
+}
+
+static int localVictim(int my_id, int attempt, unsigned long long *rng)
+{
+    return steal_order[my_id][attempt];
+}
+
+static int neighborVictim(int my_id, int attempt, unsigned long long *rng)
+{
+    return (my_id + 1 + attempt) % num_cores;
+}
+
+static int randomVictim(int my_id, int attempt, unsigned long long *rng)
+{
+    int victim = nextRandom(rng) % (num_cores - 1);
+    return victim >= my_id ? victim + 1 : victim; // Any core but the thief
+}
+
+static int largestVictim(int my_id, int attempt, unsigned long long *rng)
+{
+    int largest = atomic_load_explicit(&largest_queue, memory_order_relaxed);
+    if (attempt == 0 && largest != my_id)
+    {
+        return largest;
+    }
+    return steal_order[my_id][attempt];
+}
+
+static const struct
+{
+    const char *name;
+    VictimPolicy select;
+} victim_policies[] = {
+    {"local", localVictim},
+    {"neighbor", neighborVictim},
+    {"random", randomVictim},
+    {"largest", largestVictim},
+};
+
+static VictimPolicy select_victim = localVictim;
+
+int setVictimPolicy(const char *name)
+{
+    for (int i = 0; i < (int)(sizeof(victim_policies) / sizeof(victim_policies[0])); i++)
+    {
+        if (strcmp(name, victim_policies[i].name) == 0)
+        {
+            select_victim = victim_policies[i].select;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+long getStealsFrom(int victim)
+{
+    long steals = 0;
+    for (int i = 0; i < num_cores; i++)
+    {
+        steals += steal_counts[i].from[victim];
+    }
+    return steals;
+}
+
+// Run To Quantum
+// - An unfinished task normally goes back to the queue after every slice (a 100 us pause and a submit)
+// - With run_quantum > 1 the worker keeps running it instead, as long as:
+//   - fairness: the own queue and inbox are empty, or the task ran fewer than run_quantum slices in a row
+//   - no thief is waiting: no parked worker could steal from the queue once the task is back in it
+static int run_quantum = 1;
+
+void setRunQuantum(int slices)
+{
+    run_quantum = slices < 1 ? 1 : slices;
+}
+
+static int keepRunning(int my_id, WorkBalancerQueue *my_queue, Task *task, int run)
+{
+    if (task->task_duration <= 0 || run_quantum == 1 || atomic_load_explicit(&stop_threads, memory_order_relaxed))
+    {
+        return 0;
+    }
+    int queue_size = getQueueSize(my_queue);
+    int waiting = queue_size > 0 || atomic_load_explicit(&my_queue->inbox, memory_order_relaxed) != NULL;
+    if (waiting && run >= run_quantum)
+    {
+        return 0;
+    }
+
+    int thieves = virtual_mode ? virtualThiefWaiting(my_id)
+                               : (atomic_load_explicit(&parked_workers, memory_order_relaxed) & ~(1ULL << my_id)) != 0;
+    int high_watermark, low_watermark;
+    calculateWatermarks(my_id, &high_watermark, &low_watermark);
+    return !(thieves && queue_size + 1 > high_watermark);
 }
 
 // Main Thread Processing Loop
@@ -69,61 +544,96 @@ void calculateWatermarks(int my_id, int *high_watermark, int *low_watermark)
 // - Adaptive behavior: Uses dynamic watermarks
 // - Thread-safe operations: Handles shared data with synchronization
 
-// This function is the main function that each thread will execute.
-// It will fetch tasks from its own queue or from other queues if the current queue is below the low watermark.
-// It will then execute the task and reinsert it back into the queue if it is not complete.
-// It will also sleep for a short time before reinserting the task to allow other tasks to progress.
-void *processJobs(void *arg)
+// This function finds the next task of a worker, shared by the threads and the virtual time mode.
+// It will steal from other queues if the current queue is below the low watermark, else fetch from its own queue.
+static Task *findTask(int my_id, WorkBalancerQueue *my_queue, unsigned int *iterations, unsigned long long *rng)
 {
-    ThreadArguments *my_arg = (ThreadArguments *)arg;
-    WorkBalancerQueue *my_queue = my_arg->q;
-    int my_id = my_arg->id;
+    Task *task = NULL;
 
-    while (!stop_threads)
+    // Tasks delivered by other threads enter the queue here
+    if (atomic_load_explicit(&my_queue->inbox, memory_order_relaxed) != NULL && drainInjected(my_queue) > 0)
     {
-        Task *task = NULL;
-        int queue_size = getQueueSize(my_queue);
+        wakeIdleWorker(my_queue);
+    }
+    int queue_size = getQueueSize(my_queue);
 
-        // Dynamic load balancing thresholds
-        // - Adapts to current system state
-        // - Balances work distribution vs cache efficiency
+    // Dynamic load balancing thresholds
+    // - Adapts to current system state
+    // - Balances work distribution vs cache efficiency
 
-        int high_watermark, low_watermark;
-        calculateWatermarks(my_id, &high_watermark, &low_watermark);
+    if ((*iterations)++ % LOAD_PUBLISH_PERIOD == 0)
+    {
+        publishLoadSummary();
+    }
+    int high_watermark, low_watermark;
+    calculateWatermarks(my_id, &high_watermark, &low_watermark);
 
-        // Work stealing logic
-        // Cache trade-off: Accepts potential cache misses for better load distribution
-        // - Accepts cache misses for better load balance
-        // - Balances between cache efficiency and load distribution
-        if (queue_size < low_watermark)
+    // Work stealing logic
+    // Cache trade-off: Accepts potential cache misses for better load distribution
+    // - Accepts cache misses for better load balance
+    // - Balances between cache efficiency and load distribution
+    unsigned long long stealable = stealableQueues(my_id);
+    if (queue_size < low_watermark && stealable != 0)
+    {
+        // Steal attempt loop
+        // - Only the queues the load summary saw above the high watermark, no polling of the others
+        // - Prioritizes heavily loaded queues
+        // - The victim policy picks the order, see Victim Selection
+        for (int k = 0; k < num_cores - 1; k++)
         {
-            // Steal attempt loop
-            // - Checks other queues for excess work
-            // - Prioritizes heavily loaded queues
-            for (int i = 0; i < NUM_CORES; i++)
+            int i = select_victim(my_id, k, rng);
+            if (stealable & (1ULL << i))
             {
-                if (i != my_id)
+                core_metrics[my_id].steal_attempts++;
+                task = fetchHalfFromOthers(processor_queues[i], my_queue);
+                if (task != NULL)
                 {
-                    int other_size = getQueueSize(processor_queues[i]);
-                    if (other_size > high_watermark)
+                    core_metrics[my_id].steals++;
+                    steal_counts[my_id].from[i]++;
+                    if (atomic_load(&processor_queues[i]->returned) != NULL)
                     {
-                        task = fetchTaskFromOthers(processor_queues[i]);
-                        if (task != NULL)
-                            break;
+                        wakeOwner(i); // Warm tasks were handed back
                     }
+                    wakeIdleWorker(my_queue); // The rest of the batch may be worth stealing
+                    break;
                 }
             }
         }
+    }
 
-        // Local queue processing
-        // - Maintains cache affinity
-        // - Reduces inter-core communication
+    // Local queue processing
+    // - Maintains cache affinity
+    // - Reduces inter-core communication
 
-        // If no task was stolen (or queue was not low), try own queue
-        if (task == NULL)
+    // If no task was stolen (or queue was not low), try own queue
+    if (task == NULL)
+    {
+        task = fetchTask(my_queue);
+        if (task != NULL)
         {
-            task = fetchTask(my_queue);
+            core_metrics[my_id].local_fetches++;
         }
+    }
+    return task;
+}
+
+// This function is the main function that each thread will execute.
+// It will fetch tasks from its own queue or from other queues if the current queue is below the low watermark.
+// It will then execute the task and reinsert it back into the queue if it is not complete.
+// It will also sleep for a short time before reinserting the task to allow other tasks to progress.
+void *processJobs(void *arg)
+{
+    ThreadArguments *my_arg = (ThreadArguments *)arg;
+    WorkBalancerQueue *my_queue = my_arg->q;
+    int my_id = my_arg->id;
+    pinToCpu(worker_cpu[my_id]);
+    unsigned int iterations = 0;
+    unsigned long long rng = 0x9E3779B97F4A7C15ULL * (my_id + 1); // Distinct nonzero seed per worker
+    logParked(my_id, 0);
+
+    while (!atomic_load(&stop_threads))
+    {
+        Task *task = findTask(my_id, my_queue, &iterations, &rng);
 
         // Task execution and management
         // - Includes cache warm-up considerations
@@ -131,8 +641,17 @@ void *processJobs(void *arg)
 
         if (task != NULL)
         {
-            // Execute the task
+            // Execute the task, for more than one slice in a row with run to quantum
+            long long started = metricsNow();
+            taskStarted(my_id, task, started);
             executeJob(task, my_queue, my_id);
+            for (int run = 1; keepRunning(my_id, my_queue, task, run); run++)
+            {
+                core_metrics[my_id].continued++;
+                executeJob(task, my_queue, my_id);
+            }
+            long long ended = metricsNow();
+            core_metrics[my_id].busy_us += ended - started;
 
             // Task resubmission logic
             // - Implements task continuity
@@ -143,24 +662,29 @@ void *processJobs(void *arg)
                 // - Allows other tasks to progress
                 // - Improves overall fairness
                 usleep(100);
+                core_metrics[my_id].requeues++;
+                taskRequeued(task, metricsNow()); // Before the submit, another core may take it right away
                 submitTask(my_queue, task);
+                wakeIdleWorker(my_queue);
             }
             else
             {
                 // Clean up completed tasks
-                free(task->task_id);
-                free(task);
+                // - Back to this core's pool, no free in the scheduling loop
+                taskFinished(my_id, task, ended);
+                releaseTask(my_id, task);
             }
         }
         else
         {
-            // Backoff strategy when no work is available
+            // Parking when no work is available
             // - Reduces contention
-            // - Saves CPU cycles
-            usleep(1000);
+            // - Saves CPU cycles, woken as soon as stealable work is submitted
+            parkWorker(my_id);
         }
     }
 
+    logParked(my_id, 1); // Done logging
     free(my_arg);
     pthread_exit(NULL);
 }
@@ -178,10 +702,309 @@ void initSharedVariables()
     // Initialize per-core queues
     // - Distributed queue structure for better cache locality
     // - Independent synchronization domains
-    for (int i = 0; i < NUM_CORES; i++)
+    // - Each queue is placed on its worker's CPU
+    detectTopology();
+    pthread_t placers[MAX_CORES];
+    for (int i = 0; i < num_cores; i++)
+    {
+        pthread_create(&placers[i], NULL, placeQueue, (void *)(long)i);
+    }
+    for (int i = 0; i < num_cores; i++)
+    {
+        pthread_join(placers[i], NULL);
+        finished_jobs[i].count = 0; // Reset finished jobs counter
+        pthread_mutex_init(&parking_slots[i].lock, NULL);
+        pthread_cond_init(&parking_slots[i].cond, NULL);
+        parking_slots[i].woken = 0;
+    }
+}
+
+
+// Virtual Time
+// Design considerations:
+// - Discrete-event clock in microseconds, run on the calling thread, no sleeping
+// - Same queues, load summary, victim policies and stealing as the threads; only the slice
+//   (CYCLE ms), the delay before a requeue (100 us) and parking are simulated
+// - Deterministic: events at the same time run in the order they were scheduled, and the
+//   seed only feeds the workers' random generators
+#define VT_SLICE_US (CYCLE * 1000LL)
+#define VT_REQUEUE_US 100LL
+#define VT_RETRY_US 1LL // Work was visible but could not be taken, try again right after
+#define VT_HEAP_RESERVE 64 // Events per core the heap holds before it grows, stale park timeouts included
+
+enum
+{
+    VT_STEP,      // Look for a task
+    VT_SLICE_END, // The running slice is over
+    VT_REQUEUE    // Put the running task back into the queue
+};
+
+typedef struct VirtualEvent
+{
+    long long time;
+    long long seq;        // Scheduling order, breaks ties between events at the same time
+    long long generation; // Stale if the core's generation moved on (a parked core was woken)
+    int core;
+    int kind;
+} VirtualEvent;
+
+typedef struct VirtualCore
+{
+    Task *running;
+    int run; // Slices the running task ran in a row
+    unsigned int iterations;
+    unsigned long long rng;
+    int parked;
+    long long parked_at; // Simulated time the core parked, for its idle time
+    long long generation;
+} VirtualCore;
+
+static VirtualEvent *vt_heap = NULL;
+static int vt_heap_size = 0, vt_heap_capacity = 0;
+static long long vt_seq = 0, vt_now = 0;
+static VirtualCore vt_cores[MAX_CORES];
+
+static int vtBefore(const VirtualEvent *a, const VirtualEvent *b)
+{
+    return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static void vtSchedule(int core, int kind, long long time)
+{
+    if (vt_heap_size == vt_heap_capacity)
+    {
+        vt_heap_capacity = vt_heap_capacity ? vt_heap_capacity * 2 : 256;
+        vt_heap = realloc(vt_heap, vt_heap_capacity * sizeof(VirtualEvent));
+    }
+    VirtualEvent event = {time, vt_seq++, vt_cores[core].generation, core, kind};
+    int i = vt_heap_size++;
+    while (i > 0 && vtBefore(&event, &vt_heap[(i - 1) / 2]))
+    {
+        vt_heap[i] = vt_heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    vt_heap[i] = event;
+}
+
+static VirtualEvent vtNext()
+{
+    VirtualEvent first = vt_heap[0];
+    VirtualEvent last = vt_heap[--vt_heap_size];
+    int i = 0;
+    for (;;)
+    {
+        int child = 2 * i + 1;
+        if (child >= vt_heap_size)
+            break;
+        if (child + 1 < vt_heap_size && vtBefore(&vt_heap[child + 1], &vt_heap[child]))
+            child++;
+        if (!vtBefore(&vt_heap[child], &last))
+            break;
+        vt_heap[i] = vt_heap[child];
+        i = child;
+    }
+    vt_heap[i] = last;
+    return first;
+}
+
+// A parked core runs again at the current time
+static void vtUnpark(int core)
+{
+    VirtualCore *vc = &vt_cores[core];
+    if (vc->parked)
+    {
+        vc->parked = 0;
+        if (vt_now > vc->parked_at)
+            core_metrics[core].idle_us += vt_now - vc->parked_at;
+    }
+}
+
+// Simulated wakeIdleWorker: the lowest parked core steps now, its timeout event becomes stale
+static void virtualWake(WorkBalancerQueue *q)
+{
+    int high_watermark, low_watermark;
+    calculateWatermarks(-1, &high_watermark, &low_watermark);
+    if (getQueueSize(q) <= high_watermark)
+    {
+        return;
+    }
+    for (int i = 0; i < num_cores; i++)
+    {
+        if (vt_cores[i].parked)
+        {
+            publishLoadSummary();
+            vtUnpark(i);
+            vt_cores[i].generation++;
+            vtSchedule(i, VT_STEP, vt_now);
+            return;
+        }
+    }
+}
+
+// Simulated wakeup of a core that received tasks
+static void virtualWakeCore(int core)
+{
+    if (vt_cores[core].parked)
+    {
+        vtUnpark(core);
+        vt_cores[core].generation++;
+        vtSchedule(core, VT_STEP, vt_now);
+    }
+}
+
+static int virtualThiefWaiting(int my_id)
+{
+    for (int i = 0; i < num_cores; i++)
+    {
+        if (i != my_id && vt_cores[i].parked)
+            return 1;
+    }
+    return 0;
+}
+
+// Start a slice of the core's running task
+static void vtRunSlice(int core, long long *busy_until)
+{
+    Task *task = vt_cores[core].running;
+    core_metrics[core].busy_us += VT_SLICE_US;
+    executeSlice(task, processor_queues[core], core);
+    if (task->task_duration == 0) // Recorded now, the run stops as soon as the last job is counted
+    {
+        taskFinished(core, task, vt_now + VT_SLICE_US);
+    }
+    vtSchedule(core, VT_SLICE_END, vt_now + VT_SLICE_US);
+    if (vt_now + VT_SLICE_US > *busy_until)
+        *busy_until = vt_now + VT_SLICE_US;
+}
+
+// One iteration of processJobs for a virtual core
+static void vtStep(int core, long long *busy_until)
+{
+    VirtualCore *vc = &vt_cores[core];
+    Task *task = findTask(core, processor_queues[core], &vc->iterations, &vc->rng);
+    if (task != NULL)
+    {
+        taskStarted(core, task, vt_now);
+        vc->running = task;
+        vc->run = 1;
+        vtRunSlice(core, busy_until);
+        return;
+    }
+
+    if (workAvailable(core, awaitLoadSummary())) // Same last check as parkWorker
     {
-        processor_queues[i] = malloc(sizeof(WorkBalancerQueue));
-        WorkBalancerQueue_Init(processor_queues[i]); // Initialize WBQ for each core
-        finished_jobs[i] = 0;                        // Reset finished jobs counter
+        vtSchedule(core, VT_STEP, vt_now + VT_RETRY_US);
+    }
+    else
+    {
+        vc->parked = 1;
+        vc->parked_at = vt_now;
+        vtSchedule(core, VT_STEP, vt_now + PARK_TIMEOUT_MS * 1000LL);
     }
 }
+
+void prepareVirtual()
+{
+    // Main is the owner of every queue until runVirtual
+    // Each queue is sized for its own inbox, or for an even share plus a steal batch when that is larger,
+    // so the first drains and most steals fit without growing it
+    long injected[MAX_CORES], total = 0;
+    for (int i = 0; i < num_cores; i++)
+    {
+        injected[i] = 0;
+        for (Task *task = atomic_load(&processor_queues[i]->inbox); task != NULL; task = task->next)
+        {
+            injected[i]++;
+        }
+        total += injected[i];
+    }
+    long share = total / num_cores + STEAL_BATCH_MAX;
+    for (int i = 0; i < num_cores; i++)
+    {
+        reserveTasks(processor_queues[i], injected[i] > share ? injected[i] : share);
+    }
+    if (vt_heap_capacity < VT_HEAP_RESERVE * num_cores)
+    {
+        vt_heap_capacity = VT_HEAP_RESERVE * num_cores;
+        vt_heap = realloc(vt_heap, vt_heap_capacity * sizeof(VirtualEvent));
+    }
+}
+
+double runVirtual(unsigned long long seed, const Arrival *arrivals, long arrival_count)
+{
+    long long busy_until = 0;
+    long next_arrival = 0;
+    virtual_mode = 1;
+    vt_summarized_changes = -1; // Queues were filled since any earlier summary
+    countLoadChanges(&vt_load_changes);
+    for (int i = 0; i < num_cores; i++)
+    {
+        vt_cores[i].rng = (seed + 1) * 0x9E3779B97F4A7C15ULL * (i + 1) | 1; // Nonzero
+        vtSchedule(i, VT_STEP, 0);
+    }
+
+    while (atomic_load(&jobs_outstanding) > 0 && vt_heap_size > 0)
+    {
+        // Arrivals go before core events at the same time
+        if (next_arrival < arrival_count && arrivals[next_arrival].time_ms * 1000 <= vt_heap[0].time)
+        {
+            const Arrival *arrival = &arrivals[next_arrival++];
+            Task *task = arrival->task;
+            vt_now = arrival->time_ms * 1000;
+            setVirtualTime(vt_now);
+            deliverTasks(arrival->core, &task, 1);
+            continue;
+        }
+
+        VirtualEvent event = vtNext();
+        VirtualCore *vc = &vt_cores[event.core];
+        if (event.generation != vc->generation)
+        {
+            continue; // Cancelled by a wake
+        }
+        vt_now = event.time;
+        setVirtualTime(vt_now);
+        vtUnpark(event.core);
+
+        if (event.kind == VT_SLICE_END)
+        {
+            if (keepRunning(event.core, processor_queues[event.core], vc->running, vc->run))
+            {
+                core_metrics[event.core].continued++;
+                vc->run++;
+                vtRunSlice(event.core, &busy_until);
+                continue;
+            }
+            if (vc->running->task_duration > 0)
+            {
+                core_metrics[event.core].requeues++;
+                vtSchedule(event.core, VT_REQUEUE, vt_now + VT_REQUEUE_US);
+                continue;
+            }
+            releaseTask(event.core, vc->running);
+            vc->running = NULL;
+        }
+        else if (event.kind == VT_REQUEUE)
+        {
+            taskRequeued(vc->running, vt_now);
+            submitTask(processor_queues[event.core], vc->running);
+            wakeIdleWorker(processor_queues[event.core]);
+            vc->running = NULL;
+        }
+        vtStep(event.core, &busy_until);
+    }
+
+    // Cores still parked stay idle until the last slice ends
+    vt_now = busy_until;
+    for (int i = 0; i < num_cores; i++)
+    {
+        vtUnpark(i);
+    }
+
+    free(vt_heap);
+    vt_heap = NULL;
+    vt_heap_size = vt_heap_capacity = 0;
+    countLoadChanges(NULL);
+    virtual_mode = 0;
+    return busy_until / 1000.0;
+}
\ No newline at end of file
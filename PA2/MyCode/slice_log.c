@@ -0,0 +1,261 @@
+// Barış Pome - CS307 - Operating Systems Course - Fall 2024-2025
+// This is slice_log.c file
+// Slice log:
+// - Every worker appends compact records to its own ring, no stdout lock in the scheduling loop
+// - A drainer thread merges the rings in timestamp order and prints the same lines executeJob used to print
+// - The drainer only prints a record once no ring can still produce an earlier one
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <sched.h>
+#include "wbq.h"
+
+extern int num_cores;
+
+#define LOG_RING_SIZE 4096 // Records per core, must be a power of two
+#define LOG_DRAIN_SLEEP_US 1000
+#define LOG_LINE_MAX 1024 // Lines with longer task names are printed with printf
+
+enum
+{
+    LOG_EXECUTED,
+    LOG_FINISHED
+};
+
+// One slice of one task, formatted only by the drainer
+typedef struct LogRecord
+{
+    long long time; // ns since the epoch of the clock, or a sequence number in virtual mode
+    double ms;      // Time the slice executed
+    int task;       // Index in the task id table, the Task itself may be reused
+    short core;
+    short kind;
+} LogRecord;
+
+// Single producer (the core's worker), single consumer (the drainer) ring.
+// parked is set while the worker is parked: it cannot log anything older than the time it wakes up.
+typedef struct LogRing
+{
+    _Alignas(CACHE_LINE) _Atomic long head; // Next record to write, written by the worker
+    _Atomic int parked;
+    _Alignas(CACHE_LINE) _Atomic long tail; // Next record to print, written by the drainer
+    long long last_time;                    // Time of the last record printed from this ring
+    LogRecord records[LOG_RING_SIZE];
+} LogRing;
+
+static LogRing log_rings[MAX_CORES];
+static int log_mode = LOG_RINGS;
+static int log_virtual = 0;
+static long long log_sequence = 0; // Virtual mode only, one thread logs
+static pthread_t drainer;
+static int drainer_running = 0;
+static _Atomic int drainer_stop = 0;
+
+static long long logTime()
+{
+    if (log_virtual)
+    {
+        return ++log_sequence;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// Appends the decimal digits of num to p, returns the new end.
+static char *putDecimal(char *p, long long num)
+{
+    char digits[20];
+    int n = 0;
+    do
+    {
+        digits[n++] = '0' + num % 10;
+        num /= 10;
+    } while (num);
+    while (n)
+    {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+// Same lines as printf("Processor %d: ... %.2f ms\n"), formatted by hand: printf's parsing and
+// float conversion were most of the cost of a logged slice.
+// Slice times printf could round differently (near a half cent, negative or huge) still go through printf.
+static void printRecord(const LogRecord *r)
+{
+    const char *name = taskIdName(r->task);
+    size_t length = strlen(name);
+    double cents = r->ms * 100;
+    long long rounded = (long long)(cents + 0.5);
+    double fraction = cents - (long long)cents;
+    if (length > LOG_LINE_MAX - 64 || r->core < 0 || !(cents >= 0 && cents < 1e15) ||
+        (fraction > 0.5 - 1e-6 && fraction < 0.5 + 1e-6))
+    {
+        if (r->kind == LOG_FINISHED)
+            printf("Processor %d: Finished task %s\n", r->core, name);
+        else
+            printf("Processor %d: Executed task %s for %.2f ms\n", r->core, name, r->ms);
+        return;
+    }
+
+    char line[LOG_LINE_MAX];
+    char *p = line;
+    memcpy(p, "Processor ", 10);
+    p = putDecimal(p + 10, r->core);
+    if (r->kind == LOG_FINISHED)
+    {
+        memcpy(p, ": Finished task ", 16);
+        p += 16;
+        memcpy(p, name, length);
+        p += length;
+    }
+    else
+    {
+        memcpy(p, ": Executed task ", 16);
+        p += 16;
+        memcpy(p, name, length);
+        p += length;
+        memcpy(p, " for ", 5);
+        p = putDecimal(p + 5, rounded / 100);
+        *p++ = '.';
+        *p++ = '0' + rounded / 10 % 10;
+        *p++ = '0' + rounded % 10;
+        memcpy(p, " ms", 3);
+        p += 3;
+    }
+    *p++ = '\n';
+    fwrite(line, 1, p - line, stdout);
+}
+
+// Print every record older than what any ring can still produce, in time order.
+// With final set, the workers are done and everything is printed.
+// Returns the number of records printed.
+static long drainRings(int final)
+{
+    // A parked worker's next record is newer than now, taken before its parked flag is read
+    long long now = final ? LLONG_MAX : logTime();
+    atomic_thread_fence(memory_order_seq_cst);
+    long printed = 0;
+
+    for (;;)
+    {
+        int best = -1;
+        long long best_time = LLONG_MAX, bound = LLONG_MAX;
+        for (int i = 0; i < num_cores; i++)
+        {
+            LogRing *ring = &log_rings[i];
+            long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            if (tail != atomic_load_explicit(&ring->head, memory_order_acquire))
+            {
+                long long time = ring->records[tail & (LOG_RING_SIZE - 1)].time;
+                if (time < best_time)
+                {
+                    best_time = time;
+                    best = i;
+                }
+            }
+            else if (!final)
+            {
+                // An empty ring of a running worker only bounds by what it printed last
+                long long ring_bound = atomic_load(&ring->parked) ? now : ring->last_time;
+                if (ring_bound < bound)
+                    bound = ring_bound;
+            }
+        }
+        if (best < 0 || best_time > bound)
+        {
+            return printed;
+        }
+
+        LogRing *ring = &log_rings[best];
+        long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        printRecord(&ring->records[tail & (LOG_RING_SIZE - 1)]);
+        ring->last_time = best_time;
+        atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+        printed++;
+    }
+}
+
+static void *drainLog(void *arg)
+{
+    while (!atomic_load(&drainer_stop))
+    {
+        if (drainRings(0) == 0)
+        {
+            struct timespec pause = {0, LOG_DRAIN_SLEEP_US * 1000L};
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+}
+
+void startLog(int mode, int virtual)
+{
+    log_mode = mode;
+    log_virtual = virtual;
+    for (int i = 0; i < num_cores; i++)
+    {
+        atomic_store(&log_rings[i].head, 0);
+        atomic_store(&log_rings[i].tail, 0);
+        atomic_store(&log_rings[i].parked, 1); // Not started yet, same as parked
+        log_rings[i].last_time = 0;
+    }
+    if (mode == LOG_RINGS && !virtual)
+    {
+        atomic_store(&drainer_stop, 0);
+        drainer_running = pthread_create(&drainer, NULL, drainLog, NULL) == 0;
+    }
+}
+
+void stopLog()
+{
+    if (drainer_running)
+    {
+        atomic_store(&drainer_stop, 1);
+        pthread_join(drainer, NULL);
+        drainer_running = 0;
+    }
+    drainRings(1);
+}
+
+void logParked(int core, int parked)
+{
+    atomic_store(&log_rings[core].parked, parked); // Sequentially consistent, see drainRings
+}
+
+void logSlice(int core, const Task *task, double ms, int finished)
+{
+    if (log_mode == LOG_OFF)
+    {
+        return;
+    }
+    if (log_mode == LOG_STDIO || log_virtual)
+    {
+        // In virtual time the single logging thread already logs in sequence order, the merge would only
+        // reproduce it
+        LogRecord r = {0, ms, task->id, (short)core, (short)(finished ? LOG_FINISHED : LOG_EXECUTED)};
+        printRecord(&r);
+        return;
+    }
+
+    LogRing *ring = &log_rings[core];
+    long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == LOG_RING_SIZE)
+    {
+        // Full: without a drainer this is the only logging thread and prints everything itself
+        if (!drainer_running)
+            drainRings(1);
+        else
+            sched_yield();
+    }
+    LogRecord *r = &ring->records[head & (LOG_RING_SIZE - 1)];
+    r->time = logTime();
+    r->ms = ms;
+    r->task = task->id;
+    r->core = (short)core;
+    r->kind = finished ? LOG_FINISHED : LOG_EXECUTED;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
@@ -0,0 +1,354 @@
+// Barış Pome - CS307 - Operating Systems Course - Fall 2024-2025
+// This is task_loader.c file
+// Streaming task loader:
+// - The input is mapped with mmap, no line length limit and no copy through stdio
+// - The file is split into line-aligned chunks that are counted and parsed by parallel threads
+// - Tasks are delivered to their core while the workers already run; "id-duration@ms" tasks
+//   are kept aside and delivered at their arrival time
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wbq.h"
+
+#define LOADER_MAX_THREADS 8
+#define LOADER_MIN_CHUNK (64 * 1024) // Smaller files get fewer threads
+#define LOADER_BATCH 256             // Untimed tasks of a line delivered at once
+#define LOADER_MAX_NAME 1024         // Longer task names are cut
+
+extern WorkBalancerQueue **processor_queues;
+
+struct TaskFile
+{
+    const char *data;
+    size_t size;
+    int chunks;
+    const char *chunk_start[LOADER_MAX_THREADS + 1]; // chunk_start[chunks] is the end of the file
+    int chunk_line[LOADER_MAX_THREADS + 1];          // Index of the first line of every chunk
+    int lines;
+    long *line_tasks; // Upper bound of the tasks of every line, from the counting pass
+    Arrival *arrivals; // Timed tasks, sorted by arrival
+    long arrival_count;
+};
+
+// This struct is the work of one loader thread.
+typedef struct ChunkJob
+{
+    TaskFile *f;
+    int index;
+    int lines;
+    long *line_tasks, line_capacity;
+    long tasks;
+    Arrival *arrivals;
+    long arrival_count, arrival_capacity;
+} ChunkJob;
+
+static int isSeparator(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Count the lines of a chunk like fgets would: every newline, plus an unterminated last line
+// Every task has a dash, so the dashes of a line bound its tasks
+static void *countChunk(void *arg)
+{
+    ChunkJob *job = arg;
+    const char *p = job->f->chunk_start[job->index];
+    const char *end = job->f->chunk_start[job->index + 1];
+    int lines = 0;
+    while (p < end)
+    {
+        const char *newline = memchr(p, '\n', end - p);
+        const char *line_end = newline ? newline : end;
+        long dashes = 0;
+        for (const char *dash = memchr(p, '-', line_end - p); dash != NULL; dash = memchr(dash + 1, '-', line_end - dash - 1))
+            dashes++;
+        if (lines == job->line_capacity)
+        {
+            job->line_capacity = job->line_capacity ? job->line_capacity * 2 : 64;
+            job->line_tasks = realloc(job->line_tasks, job->line_capacity * sizeof(long));
+        }
+        job->line_tasks[lines++] = dashes;
+        if (newline == NULL)
+            break;
+        p = newline + 1;
+    }
+    job->lines = lines;
+    return NULL;
+}
+
+TaskFile *openTaskFile(const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    TaskFile *f = calloc(1, sizeof(TaskFile));
+    f->size = st.st_size;
+    if (f->size > 0)
+    {
+        void *data = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            free(f);
+            return NULL;
+        }
+        madvise(data, f->size, MADV_SEQUENTIAL);
+        f->data = data;
+    }
+    close(fd);
+
+    // Line-aligned chunks, one per thread
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = f->size / LOADER_MIN_CHUNK + 1;
+    if (threads > online)
+        threads = online > 0 ? online : 1;
+    if (threads > LOADER_MAX_THREADS)
+        threads = LOADER_MAX_THREADS;
+
+    const char *end = f->data + f->size;
+    f->chunk_start[0] = f->data;
+    f->chunks = 0;
+    for (int i = 1; i <= threads; i++)
+    {
+        const char *p = i == threads ? end : f->data + f->size * i / threads;
+        if (p < f->chunk_start[f->chunks])
+            p = f->chunk_start[f->chunks];
+        if (p < end && p > f->data && p[-1] != '\n') // Move to the start of the next line
+        {
+            const char *newline = memchr(p, '\n', end - p);
+            p = newline ? newline + 1 : end;
+        }
+        if (p > f->chunk_start[f->chunks] || i == threads)
+            f->chunk_start[++f->chunks] = p;
+    }
+
+    // Count lines in parallel, then number the first line of every chunk
+    ChunkJob jobs[LOADER_MAX_THREADS] = {0};
+    pthread_t ids[LOADER_MAX_THREADS];
+    for (int i = 0; i < f->chunks; i++)
+    {
+        jobs[i].f = f;
+        jobs[i].index = i;
+        pthread_create(&ids[i], NULL, countChunk, &jobs[i]);
+    }
+    f->lines = 0;
+    for (int i = 0; i < f->chunks; i++)
+    {
+        pthread_join(ids[i], NULL);
+        f->chunk_line[i] = f->lines;
+        f->lines += jobs[i].lines;
+    }
+    f->chunk_line[f->chunks] = f->lines;
+
+    f->line_tasks = malloc((f->lines ? f->lines : 1) * sizeof(long));
+    for (int i = 0; i < f->chunks; i++)
+    {
+        memcpy(f->line_tasks + f->chunk_line[i], jobs[i].line_tasks, jobs[i].lines * sizeof(long));
+        free(jobs[i].line_tasks);
+    }
+    return f;
+}
+
+int getTaskFileLines(TaskFile *f)
+{
+    return f->lines;
+}
+
+long getTaskFileLineTasks(TaskFile *f, int line)
+{
+    return line < f->lines ? f->line_tasks[line] : 0;
+}
+
+// Hand the batched untimed tasks of a line to their core, registered first so the latch cannot open early
+static void flushBatch(int core, Task **batch, int *batched)
+{
+    if (*batched == 0)
+        return;
+    jobsRegistered(*batched);
+    deliverTasks(core, batch, *batched);
+    *batched = 0;
+}
+
+// Parse "id-duration" or "id-duration@arrival", returns 0 for anything else
+static int parseToken(const char *p, const char *end, char *name, int *duration, long long *arrival)
+{
+    const char *dash = memchr(p, '-', end - p);
+    if (dash == NULL || dash == p || dash + 1 >= end || dash[1] < '0' || dash[1] > '9')
+        return 0;
+    size_t length = dash - p < LOADER_MAX_NAME ? (size_t)(dash - p) : LOADER_MAX_NAME - 1;
+    memcpy(name, p, length);
+    name[length] = '\0';
+
+    const char *q = dash + 1;
+    long value = 0;
+    while (q < end && *q >= '0' && *q <= '9')
+        value = value * 10 + (*q++ - '0');
+    *duration = (int)value;
+
+    *arrival = 0;
+    if (q + 1 < end && *q == '@' && q[1] >= '0' && q[1] <= '9')
+    {
+        for (q++; q < end && *q >= '0' && *q <= '9'; q++)
+            *arrival = *arrival * 10 + (*q - '0');
+    }
+    return 1;
+}
+
+static void *parseChunk(void *arg)
+{
+    ChunkJob *job = arg;
+    TaskFile *f = job->f;
+    const char *p = f->chunk_start[job->index];
+    const char *end = f->chunk_start[job->index + 1];
+    int core = f->chunk_line[job->index];
+    char name[LOADER_MAX_NAME];
+    Task *batch[LOADER_BATCH];
+    int batched = 0;
+
+    while (p < end)
+    {
+        if (*p == '\n')
+        {
+            flushBatch(core, batch, &batched);
+            core++;
+            p++;
+            continue;
+        }
+        if (isSeparator(*p))
+        {
+            p++;
+            continue;
+        }
+
+        const char *token = p;
+        while (p < end && *p != '\n' && !isSeparator(*p))
+            p++;
+
+        int duration;
+        long long arrival;
+        if (!parseToken(token, p, name, &duration, &arrival))
+            continue;
+
+        Task *task = allocTask(core); // Each line is parsed by one thread, so each pool has one allocator
+        task->id = internTaskId(name);
+        task->task_id = taskIdName(task->id);
+        task->task_duration = duration;
+        task->cache_warmed_up = 1.0;
+        task->owner = processor_queues[core];
+        job->tasks++;
+
+        if (arrival > 0)
+        {
+            if (job->arrival_count == job->arrival_capacity)
+            {
+                job->arrival_capacity = job->arrival_capacity ? job->arrival_capacity * 2 : 1024;
+                job->arrivals = realloc(job->arrivals, job->arrival_capacity * sizeof(Arrival));
+            }
+            job->arrivals[job->arrival_count++] = (Arrival){arrival, 0, core, task};
+            continue;
+        }
+
+        batch[batched++] = task;
+        if (batched == LOADER_BATCH)
+            flushBatch(core, batch, &batched);
+    }
+    flushBatch(core, batch, &batched);
+    releaseTaskIdIndex(); // Names are only looked up within a chunk
+    return NULL;
+}
+
+static int compareArrivals(const void *a, const void *b)
+{
+    const Arrival *x = a, *y = b;
+    if (x->time_ms != y->time_ms)
+        return x->time_ms < y->time_ms ? -1 : 1;
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+long loadTaskFile(TaskFile *f)
+{
+    ChunkJob jobs[LOADER_MAX_THREADS] = {0};
+    pthread_t ids[LOADER_MAX_THREADS];
+    for (int i = 0; i < f->chunks; i++)
+    {
+        jobs[i].f = f;
+        jobs[i].index = i;
+        pthread_create(&ids[i], NULL, parseChunk, &jobs[i]);
+    }
+
+    long tasks = 0;
+    f->arrival_count = 0;
+    for (int i = 0; i < f->chunks; i++)
+    {
+        pthread_join(ids[i], NULL);
+        tasks += jobs[i].tasks;
+        f->arrival_count += jobs[i].arrival_count;
+    }
+
+    // Timed tasks of all chunks in file order, then sorted by arrival
+    f->arrivals = malloc((f->arrival_count ? f->arrival_count : 1) * sizeof(Arrival));
+    long n = 0;
+    for (int i = 0; i < f->chunks; i++)
+    {
+        for (long k = 0; k < jobs[i].arrival_count; k++)
+        {
+            f->arrivals[n] = jobs[i].arrivals[k];
+            f->arrivals[n].order = n;
+            n++;
+        }
+        free(jobs[i].arrivals);
+    }
+    qsort(f->arrivals, n, sizeof(Arrival), compareArrivals);
+    jobsRegistered(n);
+    return tasks;
+}
+
+const Arrival *getArrivals(TaskFile *f, long *count)
+{
+    *count = f->arrival_count;
+    return f->arrivals;
+}
+
+void dispatchArrivals(TaskFile *f, const struct timespec *start)
+{
+    for (long i = 0; i < f->arrival_count; i++)
+    {
+        Arrival *arrival = &f->arrivals[i];
+        struct timespec at = *start;
+        at.tv_sec += arrival->time_ms / 1000;
+        at.tv_nsec += (arrival->time_ms % 1000) * 1000000L;
+        if (at.tv_nsec >= 1000000000L)
+        {
+            at.tv_sec++;
+            at.tv_nsec -= 1000000000L;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &at, NULL) == EINTR)
+        {
+        }
+        deliverTasks(arrival->core, &arrival->task, 1);
+    }
+}
+
+void closeTaskFile(TaskFile *f)
+{
+    if (f->size > 0)
+        munmap((void *)f->data, f->size);
+    free(f->arrivals);
+    free(f->line_tasks);
+    free(f);
+}
@@ -6,110 +6,538 @@
 #include <pthread.h>
 #include <assert.h>
 #include <stdatomic.h>
+#include <string.h>
 #include "wbq.h"
 
 int flag_array[NUM_CORES];
 
+// Allocation counter
+// - The programs are linked with --wrap for malloc, calloc, realloc and aligned_alloc (see ALLOC_WRAP in the
+//   Makefile), so every allocation made by the simulator's own files lands here, not only this file's
+// - Allocations libc makes internally (stdio buffers, thread stacks) do not go through the wrappers
+static _Atomic long allocation_count = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size)
+{
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __real_aligned_alloc(alignment, size);
+}
+
+long getAllocationCount()
+{
+    return atomic_load_explicit(&allocation_count, memory_order_relaxed);
+}
+
+// This function allocates a buffer of the given size.
+static TaskArray *newTaskArray(long size, TaskArray *retired)
+{
+    TaskArray *a = malloc(sizeof(TaskArray) + size * sizeof(_Atomic(Task *)));
+    memset(a->slots, 0, size * sizeof(_Atomic(Task *))); // Touch the pages on the allocating CPU
+    a->size = size;
+    a->retired = retired;
+    return a;
+}
+
 // Initialize queue with thread-safe properties
-// - Sets up atomic pointers and counter
-// - Initializes synchronization primitives
+// - Sets up the indices and the first buffer
+// - No locks: the indices are the only synchronization
 void WorkBalancerQueue_Init(WorkBalancerQueue *q)
 {
-    atomic_store(&q->head, NULL);
-    atomic_store(&q->tail, NULL);
-    atomic_store(&q->count, 0);
-    pthread_mutex_init(&q->lock, NULL);
+    atomic_store(&q->top, 0);
+    atomic_store(&q->bottom, 0);
+    atomic_store(&q->array, newTaskArray(WBQ_INITIAL_CAPACITY, NULL));
+    atomic_store(&q->inbox, NULL);
+    atomic_store(&q->returned, NULL);
+    atomic_store(&q->held, 0);
+    q->front = NULL;
+    atomic_store(&q->load, 0);
+    atomic_store(&q->stolen, 0);
+    q->steal_ops = 0;
+    q->tasks_stolen = 0;
+    q->tasks_returned = 0;
+}
+
+// Free the current buffer and every buffer it replaced
+void WorkBalancerQueue_Destroy(WorkBalancerQueue *q)
+{
+    TaskArray *a = atomic_load(&q->array);
+    while (a != NULL)
+    {
+        TaskArray *retired = a->retired;
+        free(a);
+        a = retired;
+    }
+    atomic_store(&q->array, NULL);
+}
+
+// Load change counting, for a single-threaded caller (runVirtual) that wants to skip unchanged summaries
+// - A read-only NULL pointer while the threads run, the check costs a predictable branch
+static long *load_changes = NULL;
+
+void countLoadChanges(long *counter)
+{
+    load_changes = counter;
+}
+
+// Load counter of the owner
+// - Only the owner writes load, a relaxed load and store instead of a locked add on every operation
+static void addLoad(WorkBalancerQueue *q, long n)
+{
+    atomic_store_explicit(&q->load, atomic_load_explicit(&q->load, memory_order_relaxed) + n, memory_order_relaxed);
+    if (load_changes != NULL)
+        (*load_changes)++;
+}
+
+// Stolen counter, added up by the thieves
+static void addStolen(WorkBalancerQueue *q, long n)
+{
+    atomic_fetch_add_explicit(&q->stolen, n, memory_order_relaxed);
+    if (load_changes != NULL)
+        (*load_changes)++;
+}
+
+// Buffer growth, only called by the owner
+// - Copies the live range [t, b) into a buffer of the given size, a larger power of two
+// - The old buffer is retired, a thief that loaded it still reads valid slots
+//   because the owner never writes to it again
+static TaskArray *growTaskArray(WorkBalancerQueue *q, TaskArray *a, long b, long t, long size)
+{
+    TaskArray *bigger = newTaskArray(size, a);
+    for (long i = t; i < b; i++)
+    {
+        atomic_store_explicit(&bigger->slots[i & (bigger->size - 1)],
+                              atomic_load_explicit(&a->slots[i & (a->size - 1)], memory_order_relaxed),
+                              memory_order_relaxed);
+    }
+    atomic_store_explicit(&q->array, bigger, memory_order_release);
+    return bigger;
 }
 
 // Task submission with cache and thread safety considerations
 // Performance characteristics:
 // - Cache affinity: Tasks start in their original queue
-// - Synchronization: Mutex + atomic operations
-// - Load tracking: Atomic counter increment
+// - Synchronization: No lock and no CAS, only the owner writes the bottom index
+// - Load tracking: The size is bottom - top, the load counter follows it for the other cores
 void submitTask(WorkBalancerQueue *q, Task *_task)
 {
-    QueueNode *node = malloc(sizeof(QueueNode));
-    node->task = _task;
-    atomic_store(&node->next, NULL);
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    TaskArray *a = atomic_load_explicit(&q->array, memory_order_relaxed);
 
-    pthread_mutex_lock(&q->lock);
-    if (atomic_load(&q->tail) == NULL) // If the queue is empty
+    if (b - t > a->size - 1) // If the buffer is full
     {
-        atomic_store(&q->head, node); // Set the head to the new node
-        atomic_store(&q->tail, node); // Set the tail to the new node
+        a = growTaskArray(q, a, b, t, a->size * 2);
     }
-    else
+    atomic_store_explicit(&a->slots[b & (a->size - 1)], _task, memory_order_relaxed);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_release); // Publish the task to the takers
+    addLoad(q, 1);
+}
+
+// Room for n more tasks, only called by the owner
+// - Grows the buffer straight to the power of two that fits, one allocation however many doublings that is
+static TaskArray *reserveSlots(WorkBalancerQueue *q, long n, long *b, long *t)
+{
+    *b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    *t = atomic_load_explicit(&q->top, memory_order_acquire);
+    TaskArray *a = atomic_load_explicit(&q->array, memory_order_relaxed);
+    long size = a->size;
+    while (*b - *t + n > size) // Not enough free slots
     {
-        atomic_store(&atomic_load(&q->tail)->next, node); // Set the next of the tail to the new node
-        atomic_store(&q->tail, node);                     // Set the tail to the new node
+        size *= 2;
     }
-    atomic_fetch_add(&q->count, 1); // Increment the count of the queue
-    pthread_mutex_unlock(&q->lock); // Unlock the mutex
+    return size > a->size ? growTaskArray(q, a, *b, *t, size) : a;
 }
 
-// Local task fetching optimized for cache efficiency
-// - Prioritizes local queue access
-// - Maintains data locality
-// - Thread-safe task removal
-Task *fetchTask(WorkBalancerQueue *q)
+// Batch submission
+// - Same as submitTask for n tasks, the buffer grows at most once
+// - One release of the bottom index publishes all of them, takers see the whole batch at once
+void submitTasks(WorkBalancerQueue *q, Task **tasks, int n)
 {
-    pthread_mutex_lock(&q->lock);
-    QueueNode *node = atomic_load(&q->head); // Load the head of the queue
-    Task *task = NULL;
+    if (n <= 0)
+    {
+        return;
+    }
+    long b, t;
+    TaskArray *a = reserveSlots(q, n, &b, &t);
+    for (int i = 0; i < n; i++)
+    {
+        atomic_store_explicit(&a->slots[(b + i) & (a->size - 1)], tasks[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&q->bottom, b + n, memory_order_release);
+    addLoad(q, n);
+}
 
-    if (node != NULL)
+// Take the task at the top of the queue
+// - Shared by the owner and the thieves, a CAS on top decides who gets the task
+// - Fails when fewer than min_left + 1 tasks are queued
+// - Owner only pushes, so bottom never moves down and min_left is respected when the CAS succeeds
+static Task *takeTop(WorkBalancerQueue *q, long min_left)
+{
+    for (;;)
     {
-        task = node->task;
-        atomic_store(&q->head, atomic_load(&node->next)); // Set the head to the next node
-        if (atomic_load(&q->head) == NULL)
+        long t = atomic_load_explicit(&q->top, memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+
+        if (b - t <= min_left)
         {
-            atomic_store(&q->tail, NULL);
+            return NULL;
         }
-        free(node);
-        atomic_fetch_sub(&q->count, 1); // Decrement the count of the queue
+
+        TaskArray *a = atomic_load_explicit(&q->array, memory_order_acquire);
+        Task *task = atomic_load_explicit(&a->slots[t & (a->size - 1)], memory_order_relaxed);
+        if (atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1, memory_order_seq_cst,
+                                                    memory_order_relaxed))
+        {
+            return task;
+        }
+        // Another taker won this task, look again
     }
+}
 
-    pthread_mutex_unlock(&q->lock);
+// Task injection from other threads
+// - The deque has a single producer, so other threads push onto a lock-free inbox instead
+// - The owner takes the whole inbox with one exchange, no ABA problem
+void injectTask(WorkBalancerQueue *q, Task *task)
+{
+    Task *head = atomic_load_explicit(&q->inbox, memory_order_relaxed);
+    do
+    {
+        task->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&q->inbox, &head, task, memory_order_seq_cst,
+                                                    memory_order_relaxed));
+}
+
+// Capacity reservation, owner only
+// - Grows the buffer once so it holds at least n tasks, counting the ones already queued
+void reserveTasks(WorkBalancerQueue *q, long n)
+{
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    TaskArray *a = atomic_load_explicit(&q->array, memory_order_relaxed);
+    long size = a->size;
+    while (size < n)
+    {
+        size *= 2;
+    }
+    if (size > a->size)
+    {
+        growTaskArray(q, a, b, t, size);
+    }
+}
+
+int drainInjected(WorkBalancerQueue *q)
+{
+    Task *list = atomic_exchange_explicit(&q->inbox, NULL, memory_order_acquire);
+    Task *ordered = NULL;
+    long count = 0, b, t;
+    while (list != NULL) // Newest first, reverse to injection order
+    {
+        Task *next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+        count++;
+    }
+    reserveSlots(q, count, &b, &t); // One buffer for the whole inbox, the batches below never grow it
+
+    int moved = 0;
+    Task *batch[64];
+    while (ordered != NULL) // Submitted in batches, one publication each
+    {
+        int n = 0;
+        for (; ordered != NULL && n < 64; n++)
+        {
+            batch[n] = ordered;
+            ordered = ordered->next;
+            batch[n]->next = NULL;
+        }
+        submitTasks(q, batch, n);
+        moved += n;
+    }
+    return moved;
+}
+
+// Claim up to k of the oldest tasks of the deque with a single CAS on top, leaving at least min_left
+// - Used by the batch steal for its extra claim; claimed slots cannot be taken or overwritten by anyone else
+//   because the owner never takes from the bottom
+// - Returns the number of tasks claimed, the caller accounts for them in the load counter
+static long claimTop(WorkBalancerQueue *q, Task **tasks, long k, long min_left)
+{
+    for (;;)
+    {
+        long t = atomic_load_explicit(&q->top, memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+
+        long n = b - t - min_left;
+        if (n <= 0 || k <= 0)
+        {
+            return 0;
+        }
+        if (n > k)
+        {
+            n = k;
+        }
+
+        TaskArray *a = atomic_load_explicit(&q->array, memory_order_acquire);
+        for (long i = 0; i < n; i++)
+        {
+            tasks[i] = atomic_load_explicit(&a->slots[(t + i) & (a->size - 1)], memory_order_relaxed);
+        }
+        if (atomic_compare_exchange_strong_explicit(&q->top, &t, t + n, memory_order_seq_cst,
+                                                    memory_order_relaxed))
+        {
+            return n;
+        }
+        // Another taker moved top, look again
+    }
+}
+
+// Handed back tasks, owner only
+// - Thieves push whole groups onto returned, newest group first and each group newest first
+// - The owner reverses what it takes, so front holds them oldest first; it only takes more once front is empty,
+//   since later groups were claimed from further down the deque
+static Task *takeFront(WorkBalancerQueue *q)
+{
+    if (q->front == NULL && atomic_load_explicit(&q->returned, memory_order_relaxed) != NULL)
+    {
+        Task *list = atomic_exchange_explicit(&q->returned, NULL, memory_order_acquire);
+        while (list != NULL)
+        {
+            Task *next = list->next;
+            list->next = q->front;
+            q->front = list;
+            list = next;
+        }
+    }
+
+    Task *task = q->front;
+    if (task != NULL)
+    {
+        q->front = task->next;
+        task->next = NULL;
+        atomic_fetch_sub_explicit(&q->held, 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+// Local task fetching optimized for cache efficiency
+// - Prioritizes local queue access
+// - Maintains data locality
+// - Takes the oldest task: requeued tasks are served round robin as before, handed back ones first
+Task *fetchTask(WorkBalancerQueue *q)
+{
+    Task *task = takeFront(q);
+    if (task != NULL)
+    {
+        return task;
+    }
+    task = takeTop(q, 0);
+    if (task != NULL)
+    {
+        addLoad(q, -1);
+    }
     return task;
 }
 
 // Work stealing implementation for load balancing
 // Design considerations:
-// - Load Distribution: Steals from middle of queue
+// - Load Distribution: Steals the oldest task of the victim
 // - Cache Impact: Accepts cache misses for better load balance
 // - Queue Preservation: Leaves minimum tasks in source queue
 Task *fetchTaskFromOthers(WorkBalancerQueue *q)
 {
-    pthread_mutex_lock(&q->lock);
+    Task *task = takeTop(q, 1); // Leave at least one task
+    if (task != NULL)
+    {
+        addStolen(q, 1);
+    }
+    return task;
+}
 
-    if (atomic_load(&q->count) <= 1) // If the queue has only one task or is empty
-    {                                // Leave at least one task
-        pthread_mutex_unlock(&q->lock);
-        return NULL;
+// Migration cost model
+// - A task moving to another core restarts from cache_warmed_up 1.0 (see executeSlice)
+// - The cost is the extra slice time it needs to finish from there compared to staying warm
+static int slicesToFinish(int duration, double warmed_up)
+{
+    int slices = 0;
+    while (duration > 0)
+    {
+        int remaining = duration - (CYCLE * warmed_up); // Same rounding as executeSlice
+        slices++;
+        if (remaining <= 0)
+            break;
+        duration = remaining;
+        if (warmed_up < MAX_CACHE_FACTOR)
+            warmed_up += CACHE_FACTOR;
     }
+    return slices;
+}
 
-    QueueNode *first = atomic_load(&q->head);
-    QueueNode *second = atomic_load(&first->next);
+double migrationCost(const Task *task, const WorkBalancerQueue *to)
+{
+    if (task->owner == to || task->cache_warmed_up <= 1.0)
+    {
+        return 0; // Stays warm, or has nothing to lose
+    }
+    return (double)CYCLE * (slicesToFinish(task->task_duration, 1.0) - slicesToFinish(task->task_duration, task->cache_warmed_up));
+}
+
+static int affinity_stealing = 1;
+
+// Cost of stealing a task from victim to thief: only warmth on the victim is lost by the steal,
+// a task still warm on a third core is cold on both
+static double stealCost(const Task *task, const WorkBalancerQueue *victim, const WorkBalancerQueue *thief)
+{
+    return task->owner == victim ? migrationCost(task, thief) : 0;
+}
+
+void setAffinityStealing(int enabled)
+{
+    affinity_stealing = enabled;
+}
 
-    if (second == NULL) // If the second node is NULL
+// Hand claimed tasks back to their victim, in their queue order
+// - The whole group is pushed with one CAS, it stays contiguous ahead of any later group
+static void handBack(WorkBalancerQueue *q, Task **tasks, long count)
+{
+    Task *group = NULL;
+    for (long i = 0; i < count; i++) // Newest first, like the rest of the list
     {
-        pthread_mutex_unlock(&q->lock);
-        return NULL;
+        tasks[i]->next = group;
+        group = tasks[i];
     }
+    atomic_fetch_add_explicit(&q->held, count, memory_order_relaxed); // Counted before the owner can take them
+    Task *head = atomic_load_explicit(&q->returned, memory_order_relaxed);
+    do
+    {
+        tasks[0]->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&q->returned, &head, group, memory_order_seq_cst,
+                                                    memory_order_relaxed));
+}
+
+// Batch stealing for load balancing
+// Design considerations:
+// - Claims a batch at the top of the victim with one CAS that moves top over all of it
+// - Safe because the owner never takes from the bottom: the claimed slots cannot
+//   be taken or overwritten by anyone else once the CAS succeeds
+// - Cache affinity: for every task of the batch still warm on the victim (owned by it), one more task is claimed;
+//   the thief keeps the batch of tasks cheapest to migrate (cold, then long) and hands the others,
+//   all warm, back to the victim, which runs them before its newer work
+// - Queue Preservation: Claims stop one short of the bottom, the victim always keeps a task
+Task *fetchHalfFromOthers(WorkBalancerQueue *q, WorkBalancerQueue *my_queue)
+{
+    Task *stolen[2 * STEAL_BATCH_MAX];
+    long n;
+
+    for (;;)
+    {
+        long t = atomic_load_explicit(&q->top, memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
 
-    Task *task = second->task;
-    atomic_store(&first->next, atomic_load(&second->next)); // Set the next of the first node to the next of the second node
+        n = (b - t) / 2;
+        if (n <= 0) // Only one task or empty
+        {
+            return NULL;
+        }
+        if (n > STEAL_BATCH_MAX)
+        {
+            n = STEAL_BATCH_MAX;
+        }
+
+        TaskArray *a = atomic_load_explicit(&q->array, memory_order_acquire);
+        for (long i = 0; i < n; i++)
+        {
+            stolen[i] = atomic_load_explicit(&a->slots[(t + i) & (a->size - 1)], memory_order_relaxed);
+        }
+        if (atomic_compare_exchange_strong_explicit(&q->top, &t, t + n, memory_order_seq_cst,
+                                                    memory_order_relaxed))
+        {
+            break;
+        }
+        // Another taker moved top, look again
+    }
 
-    if (second == atomic_load(&q->tail)) // If the second node is the tail of the queue
+    // Warm tasks of the batch, each one may be swapped for the next task of the victim
+    long warm = 0;
+    for (long i = 0; affinity_stealing && i < n; i++)
     {
-        atomic_store(&q->tail, first);
+        if (stealCost(stolen[i], q, my_queue) > 0)
+            warm++;
     }
+    long extra = warm > 0 ? claimTop(q, stolen + n, warm, 1) : 0;
+    addStolen(q, n + extra);
 
-    atomic_fetch_sub(&q->count, 1); // Decrement the count of the queue
-    free(second);                   // Free the second node
+    if (extra > 0)
+    {
+        // Rank the claimed tasks, insertion sort of at most 2 * STEAL_BATCH_MAX tasks.
+        // At least extra of them are warm, so the last extra ranks all cost something to move.
+        double cost[2 * STEAL_BATCH_MAX];
+        int order[2 * STEAL_BATCH_MAX]; // Queue position, to hand the warm ones back in order
+        for (long i = 0; i < n + extra; i++)
+        {
+            Task *task = stolen[i];
+            double c = stealCost(task, q, my_queue);
+            long j = i;
+            for (; j > 0 && (cost[j - 1] > c || (cost[j - 1] == c && stolen[j - 1]->task_duration < task->task_duration)); j--)
+            {
+                stolen[j] = stolen[j - 1];
+                cost[j] = cost[j - 1];
+                order[j] = order[j - 1];
+            }
+            stolen[j] = task;
+            cost[j] = c;
+            order[j] = (int)i;
+        }
 
-    pthread_mutex_unlock(&q->lock);
-    return task;
+        // Back to queue order, then to the victim
+        Task **back = stolen + n;
+        for (long i = 1; i < extra; i++)
+        {
+            Task *task = back[i];
+            int position = order[n + i];
+            long j = i;
+            for (; j > 0 && order[n + j - 1] > position; j--)
+            {
+                back[j] = back[j - 1];
+                order[n + j] = order[n + j - 1];
+            }
+            back[j] = task;
+            order[n + j] = position;
+        }
+        handBack(q, back, extra);
+        my_queue->tasks_returned += extra;
+    }
+
+    submitTasks(my_queue, stolen + 1, (int)n - 1); // Keep the rest in the thief's queue
+    my_queue->steal_ops++;
+    my_queue->tasks_stolen += n;
+    return stolen[0];
 }
 
 // O(1) queue size check for load balancing decisions
@@ -118,5 +546,199 @@ Task *fetchTaskFromOthers(WorkBalancerQueue *q)
 // - Enables quick load balancing checks
 int getQueueSize(WorkBalancerQueue *q)
 {
-    return atomic_load(&q->count); // Return the count of the queue
-}
\ No newline at end of file
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+    long held = atomic_load_explicit(&q->held, memory_order_relaxed); // Handed back, not in the deque
+    return (b > t ? (int)(b - t) : 0) + (int)held; // Return the count of the queue
+}
+
+// Load counter read
+// - Follows bottom - top without reading the index lines, which every taker writes
+// - Handed back tasks are not counted, no thief can take them
+// - May be stale by the operations in flight, which is what a load summary can afford
+int getQueueLoad(WorkBalancerQueue *q)
+{
+    long stolen = atomic_load_explicit(&q->stolen, memory_order_relaxed);
+    long load = atomic_load_explicit(&q->load, memory_order_relaxed) - stolen;
+    return load > 0 ? (int)load : 0;
+}
+
+// Task Pools
+// - One pool per core, tasks are carved out of slabs that are never freed
+// - The scheduling loop only moves tasks between pools, no malloc or free per task
+static TaskPool task_pools[MAX_CORES];
+static long pool_reserve[MAX_CORES]; // Tasks placeTaskPool carves up front
+
+// Link n tasks into a free list on the calling thread, the writes are their first touch
+static Task *carveTasks(long n)
+{
+    Task *slab = malloc(n * sizeof(Task));
+    for (long i = 0; i < n; i++)
+    {
+        slab[i].next = i + 1 < n ? &slab[i + 1] : NULL;
+    }
+    return slab;
+}
+
+void reserveTaskPool(int core, long n)
+{
+    pool_reserve[core] = n;
+}
+
+void placeTaskPool(int core)
+{
+    if (pool_reserve[core] > 0 && task_pools[core].local == NULL)
+    {
+        task_pools[core].local = carveTasks(pool_reserve[core]);
+    }
+}
+
+Task *allocTask(int core)
+{
+    TaskPool *pool = &task_pools[core];
+    if (pool->local == NULL) // Take everything the workers returned so far
+    {
+        pool->local = atomic_exchange_explicit(&pool->returned, NULL, memory_order_acquire);
+    }
+    if (pool->local == NULL) // Still empty, carve a new slab
+    {
+        pool->local = carveTasks(TASK_SLAB);
+    }
+
+    Task *task = pool->local;
+    pool->local = task->next;
+    task->next = NULL;
+    return task;
+}
+
+void releaseTask(int core, Task *task)
+{
+    TaskPool *pool = &task_pools[core];
+    Task *head = atomic_load_explicit(&pool->returned, memory_order_relaxed);
+    do
+    {
+        task->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&pool->returned, &head, task, memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+// Task Id Table
+// - Ids are handed out by one atomic counter; the name of every id sits in a segment of a fixed
+//   directory, segments are allocated once and never moved, so a lookup takes no lock
+// - Names are packed into fixed-size chunks, so pointers to them stay valid
+// - Every interning thread has its own hash index and chunk: the parallel loader threads never
+//   share a write, the same name seen by two threads just gets two ids
+#define NAME_CHUNK_SIZE (64 * 1024)
+#define NAME_SEGMENT_BITS 16 // Ids per segment, as a power of two
+#define NAME_SEGMENT_SIZE (1 << NAME_SEGMENT_BITS)
+#define NAME_SEGMENTS (1 << 14)
+
+static _Atomic(const char **) name_segments[NAME_SEGMENTS]; // Name of every id, by segment
+static _Atomic int names_count = 0;
+
+static _Thread_local char *name_chunk = NULL; // Chunk of this thread currently being filled
+static _Thread_local size_t name_chunk_used = 0;
+static _Thread_local int *name_index = NULL;  // Open addressing table of id + 1, 0 marks an empty slot
+static _Thread_local int name_index_size = 0, name_index_count = 0;
+
+static unsigned long hashName(const char *name)
+{
+    unsigned long h = 5381;
+    while (*name)
+    {
+        h = h * 33 + (unsigned char)*name++;
+    }
+    return h;
+}
+
+// Rebuild the hash index of this thread with twice the slots
+static void growNameIndex()
+{
+    int size = name_index_size ? name_index_size * 2 : 1024;
+    int *index = malloc(size * sizeof(int));
+    memset(index, 0, size * sizeof(int));
+    for (int i = 0; i < name_index_size; i++)
+    {
+        if (name_index[i] == 0)
+            continue;
+        unsigned long slot = hashName(taskIdName(name_index[i] - 1)) & (size - 1);
+        while (index[slot] != 0)
+        {
+            slot = (slot + 1) & (size - 1);
+        }
+        index[slot] = name_index[i];
+    }
+    free(name_index);
+    name_index = index;
+    name_index_size = size;
+}
+
+// Segment of the given id, allocated by the first thread that needs it
+static const char **nameSegment(int id)
+{
+    _Atomic(const char **) *entry = &name_segments[id >> NAME_SEGMENT_BITS];
+    const char **segment = atomic_load_explicit(entry, memory_order_acquire);
+    if (segment == NULL)
+    {
+        const char **fresh = malloc(NAME_SEGMENT_SIZE * sizeof(char *));
+        if (atomic_compare_exchange_strong_explicit(entry, &segment, fresh, memory_order_acq_rel,
+                                                    memory_order_acquire))
+        {
+            segment = fresh;
+        }
+        else
+        {
+            free(fresh); // Another thread installed it first
+        }
+    }
+    return segment;
+}
+
+int internTaskId(const char *name)
+{
+    if (name_index_count * 2 >= name_index_size) // Keep the index at most half full
+    {
+        growNameIndex();
+    }
+
+    unsigned long slot = hashName(name) & (name_index_size - 1);
+    while (name_index[slot] != 0)
+    {
+        if (strcmp(taskIdName(name_index[slot] - 1), name) == 0) // Already interned by this thread
+        {
+            return name_index[slot] - 1;
+        }
+        slot = (slot + 1) & (name_index_size - 1);
+    }
+
+    size_t length = strlen(name) + 1;
+    if (name_chunk == NULL || name_chunk_used + length > NAME_CHUNK_SIZE)
+    {
+        name_chunk = malloc(length > NAME_CHUNK_SIZE ? length : NAME_CHUNK_SIZE);
+        name_chunk_used = 0;
+    }
+    char *stored = name_chunk + name_chunk_used;
+    memcpy(stored, name, length);
+    name_chunk_used += length;
+
+    int id = atomic_fetch_add_explicit(&names_count, 1, memory_order_relaxed);
+    assert(id < NAME_SEGMENTS * NAME_SEGMENT_SIZE);
+    // Readers get the id through the task, which is handed over with release/acquire
+    nameSegment(id)[id & (NAME_SEGMENT_SIZE - 1)] = stored;
+    name_index[slot] = id + 1;
+    name_index_count++;
+    return id;
+}
+
+void releaseTaskIdIndex()
+{
+    free(name_index);
+    name_index = NULL;
+    name_index_size = name_index_count = 0;
+}
+
+const char *taskIdName(int id)
+{
+    const char **segment = atomic_load_explicit(&name_segments[id >> NAME_SEGMENT_BITS], memory_order_acquire);
+    return segment[id & (NAME_SEGMENT_SIZE - 1)];
+}
@@ -8,11 +8,25 @@
 #include "constants.h"
 #include <stdbool.h>
 #include <pthread.h>
+#include <stdio.h>
 
 // Queue structure optimized for:
 // 1. Cache efficiency: Through local queue priority
-// 2. Synchronization: Using atomic operations and mutex locks
-// 3. Load balancing: Atomic counter for O(1) size checks
+// 2. Synchronization: Lock-free Chase-Lev style deque, the owner pushes at the bottom and every
+//    taker (owner or thief) claims the top with a single CAS
+// 3. Load balancing: O(1) size checks from the top and bottom indices, and a load counter on its own
+//    line that other cores can read without touching the indices
+
+// Initial number of slots of a queue's buffer, must be a power of two
+#ifndef WBQ_INITIAL_CAPACITY
+#define WBQ_INITIAL_CAPACITY 64
+#endif
+
+// Size of a cache line, fields written by different cores are kept this far apart
+#define CACHE_LINE 64
+
+// Upper bound of the tasks a single batch steal moves
+#define STEAL_BATCH_MAX 32
 
 // This struct is used to create the queue.
 typedef struct WorkBalancerQueue WorkBalancerQueue;
@@ -27,42 +41,111 @@ typedef struct ThreadArguments
 // This struct is used to pass the task to the executeJob function.
 typedef struct Task
 {
-    char *task_id;
+    const char *task_id;   // Interned name, owned by the task id table
+    int id;                // Index of the name in the task id table
     int task_duration;
     double cache_warmed_up;
     WorkBalancerQueue *owner;
+    struct Task *next;     // Link in a task pool or an inbox while the task is in neither queue
+    long long arrival_us;  // Metrics timestamps in us, see metrics.c
+    long long ready_us;    // Last time the task entered a queue
+    long long first_run_us;
+    long long waited_us;   // Time spent in queues so far
 } Task;
 
-// This struct is used to create the nodes of the queue.
-typedef struct QueueNode
+// Number of tasks a pool allocates at once when it runs dry
+#define TASK_SLAB 64
+
+// This struct is a per-core pool of Task objects.
+// Finished tasks are pushed back with a CAS by any worker; the single allocating thread
+// takes the whole returned list at once, so the pool is lock-free and free of ABA.
+typedef struct TaskPool
 {
-    Task *task;
-    _Atomic(struct QueueNode *) next;
-} QueueNode;
+    _Alignas(CACHE_LINE) _Atomic(Task *) returned; // Tasks released by the workers
+    _Alignas(CACHE_LINE) Task *local;              // Tasks owned by the allocating thread
+} TaskPool;
+
+// This struct holds the per-core counters of executeJob, alone on their cache line so that
+// cores finishing tasks at the same time do not invalidate each other's counters.
+typedef struct CoreCounter
+{
+    _Alignas(CACHE_LINE) int count;
+    long slices; // Slices executed, for the utilization
+} CoreCounter;
+
+// This struct is the circular buffer of a queue.
+// A full buffer is replaced by one twice its size; the old one is only retired (kept on a list)
+// since a thief may still be reading a slot from it. Retired buffers are freed with the queue.
+typedef struct TaskArray
+{
+    long size;                 // Number of slots, a power of two
+    struct TaskArray *retired; // Previously used buffer of the same queue
+    _Atomic(Task *) slots[];
+} TaskArray;
 
 // This struct is used to create the queue.
+// Fields are grouped by who writes them, one cache line per group:
+// - top: written by every taker (owner and thieves)
+// - bottom and array: written only by the owner, read by the takers; the handed back list is owner-only
+// - inbox and returned: written by any thread injecting or handing back tasks, emptied by the owner
+// - load counter: submitted minus fetched tasks written by the owner, stolen tasks added up by the thieves;
+//   read by the load summary
+// - statistics: owner-only and cold, read after the threads are joined
 typedef struct WorkBalancerQueue
 {
-    _Atomic(QueueNode *) head; // Atomic pointer for thread-safe access
-    _Atomic(QueueNode *) tail; // Atomic pointer for thread-safe access
-    _Atomic int count;         // O(1) size tracking for load balancing decisions
-    pthread_mutex_t lock;      // Coarse-grained lock for complex operations
+    _Alignas(CACHE_LINE) _Atomic long top;           // Index of the oldest task, advanced by CAS by whoever takes it
+    _Alignas(CACHE_LINE) _Atomic long bottom;        // Index of the next free slot, written only by the owner
+    _Atomic(TaskArray *) array;                      // Current buffer, replaced only by the owner
+    Task *front;                                     // Tasks handed back by thieves, oldest first, run before the deque
+    _Alignas(CACHE_LINE) _Atomic(Task *) inbox;      // Tasks injected by other threads, newest first
+    _Atomic(Task *) returned;                        // Groups of tasks handed back by thieves, newest group first
+    _Atomic long held;                               // Tasks in returned and front, counted by getQueueSize
+    _Alignas(CACHE_LINE) _Atomic long load;          // Tasks submitted minus tasks fetched, written only by the owner
+    _Atomic long stolen;                             // Tasks taken by thieves, the size is load - stolen
+    _Alignas(CACHE_LINE) long steal_ops;             // Successful batch steals made by the owner of this queue
+    long tasks_stolen;                               // Tasks those steals moved
+    long tasks_returned;                             // Warm tasks those steals handed back to their victim
 } WorkBalancerQueue;
 
 // Function declarations with performance characteristics:
 
 // Submit Task Function
 // This function is used to submit a task to the queue.
-// submitTask: O(1) operation
+// submitTask: O(1) amortized operation
 // - Cache friendly: Tasks initially stay in their original queue
-// - Synchronization: Uses mutex + atomic counter
+// - Synchronization: Lock-free, a plain store and a release of the bottom index
+// - Only the owning core may submit (or main, before the threads are started)
 void submitTask(WorkBalancerQueue *q, Task *_task);
 
+// Submit Tasks Function
+// This function submits n tasks in order, like n submitTask calls. Owner only.
+// submitTasks: O(n), one release of the bottom index for the whole batch
+void submitTasks(WorkBalancerQueue *q, Task **tasks, int n);
+
+// Inject Task Function
+// This function is used to hand a task to a queue from a thread that does not own it.
+// injectTask: O(1) lock-free push with a CAS on the inbox
+// - The task becomes visible to fetchTask and thieves once the owner drains the inbox
+void injectTask(WorkBalancerQueue *q, Task *task);
+
+// Drain Injected Function
+// This function moves the injected tasks into the queue in injection order. Owner only.
+// Returns the number of tasks moved.
+int drainInjected(WorkBalancerQueue *q);
+
+// Reserve Tasks Function
+// This function grows the queue's buffer once so it holds at least n tasks, the queued ones included.
+// Later submits and drains up to that size do not allocate. Owner only (or main, before the threads are started).
+void reserveTasks(WorkBalancerQueue *q, long n);
+
 // Fetch Task Function
 // This function is used to fetch a task from the queue.
 // fetchTask: O(1) operation
 // - Cache optimized: Prioritizes local queue access
 // - Maintains data locality
+// - Takes the oldest task so requeued tasks keep their round robin order
+// - Tasks a thief handed back come first, they are older than everything left in the deque
+// - Owner only, thieves use fetchTaskFromOthers
 Task *fetchTask(WorkBalancerQueue *q);
 
 // Fetch Task From Others Function
@@ -72,22 +155,280 @@ Task *fetchTask(WorkBalancerQueue *q);
 // - Cache trade-off: May cause cache misses but improves load distribution
 Task *fetchTaskFromOthers(WorkBalancerQueue *q);
 
+// Fetch Half From Others Function
+// This function is used to steal up to half of another queue's tasks at once.
+// fetchHalfFromOthers: One CAS on the victim per steal
+// - Load balancing: Moves half of the victim's tasks (at most STEAL_BATCH_MAX), leaving at least one
+// - Fewer steals: The thief does not come back to the same victim for every task
+// - Cache affinity: When the batch holds tasks still warm on q (q owns them), as many more are claimed and the batch is
+//   chosen among all of them by migrationCost; only warm tasks are handed back, ahead of q's newer work,
+//   and the caller should wake q's owner
+// - Returns one stolen task to run now, the rest are submitted to my_queue, which the caller must own
+Task *fetchHalfFromOthers(WorkBalancerQueue *q, WorkBalancerQueue *my_queue);
+
+// Migration Cost Function
+// This function returns the slice time in ms a task loses by moving to the queue to, because it
+// restarts cold: the extra time to finish at cache_warmed_up 1.0 instead of its current warmth.
+double migrationCost(const Task *task, const WorkBalancerQueue *to);
+
+// Set Affinity Stealing Function
+// This function turns the migration cost ranking of fetchHalfFromOthers on (default) or off.
+void setAffinityStealing(int enabled);
+
 // Initialize Queue Function
 // This function is used to initialize the queue.
 void WorkBalancerQueue_Init(WorkBalancerQueue *q);
 
+// Destroy Queue Function
+// This function frees the buffers of the queue, including retired ones.
+// No other thread may use the queue anymore.
+void WorkBalancerQueue_Destroy(WorkBalancerQueue *q);
+
 // Get Queue Size Function
 // This function is used to get the size of the queue.
 int getQueueSize(WorkBalancerQueue *q);
 
+// Get Queue Load Function
+// This function returns the load counter of the queue: the size as of its last submit, fetch or steal.
+// One relaxed load of a line the takers never CAS, meant for cores summarizing other queues.
+int getQueueLoad(WorkBalancerQueue *q);
+
+// Count Load Changes Function
+// This function makes every later change of a queue's load counters increment *counter, NULL stops it.
+// For a single-threaded run only: the increment is not atomic.
+void countLoadChanges(long *counter);
+
+// Allocate Task Function
+// This function takes a task from the pool of the given core, growing it by TASK_SLAB when empty.
+// Only one thread may allocate from a given core's pool at a time.
+Task *allocTask(int core);
+
+// Reserve Task Pool Function
+// This function sets how many tasks the pool of the given core is expected to need.
+// Call it before initSharedVariables, which carves them from the core's CPU (see placeTaskPool).
+void reserveTaskPool(int core, long n);
+
+// Place Task Pool Function
+// This function carves the reserved tasks of the given core's pool from the calling thread,
+// so they are first touched on its CPU and not by the loader. Before the pool is used.
+void placeTaskPool(int core);
+
+// Release Task Function
+// This function returns a finished task to the pool of the given core. Safe from any thread.
+void releaseTask(int core, Task *task);
+
+// Intern Task Id Function
+// This function stores a task name once per thread and returns its index in the task id table.
+// Names live until exit and never move. Thread-safe and lock-free: each thread looks names up in its
+// own index, so two threads interning the same name get two ids for it.
+int internTaskId(const char *name);
+
+// Release Task Id Index Function
+// This function frees the calling thread's lookup index. Its ids and names stay valid.
+void releaseTaskIdIndex();
+
+// Task Id Name Function
+// This function returns the name stored at the given index. Lock-free, any thread that got the id
+// through a task may call it.
+const char *taskIdName(int id);
+
+// Allocation Count Function
+// This function returns the number of malloc, calloc, realloc and aligned_alloc calls made so far by any file of the program.
+long getAllocationCount();
+
 // Execute Job Function
 // This function is used to execute a job.
 void executeJob(Task *task, WorkBalancerQueue *my_queue, int my_id);
 
+// Deliver Tasks Function
+// This function injects tasks into a core's queue and wakes the core if it is parked.
+// Safe from any thread, used for tasks arriving while the workers run.
+void deliverTasks(int core, Task **tasks, int n);
+
+// This struct is a task that enters the system time_ms after the start.
+typedef struct Arrival
+{
+    long long time_ms;
+    long order; // Position in the input, keeps arrivals at the same time in file order
+    int core;
+    Task *task;
+} Arrival;
+
+// This struct is an input file mapped by the task loader.
+typedef struct TaskFile TaskFile;
+
+// Open Task File Function
+// This function maps the file and counts its lines (one queue per line) in parallel.
+// Returns NULL if the file cannot be mapped.
+TaskFile *openTaskFile(const char *filename);
+
+// Task File Lines Function
+int getTaskFileLines(TaskFile *f);
+
+// Task File Line Tasks Function
+// This function returns an upper bound of the tasks on a line (its dashes), 0 past the last line.
+long getTaskFileLineTasks(TaskFile *f, int line);
+
+// Load Task File Function
+// This function parses the file in parallel chunks. A task is "id-duration", or
+// "id-duration@arrival" with the arrival in ms after the start. Tasks without an arrival
+// are registered and delivered to their line's core while parsing; timed ones are
+// registered and kept, sorted by arrival. Returns the number of tasks.
+long loadTaskFile(TaskFile *f);
+
+// Get Arrivals Function
+// This function returns the timed tasks of the file sorted by arrival.
+const Arrival *getArrivals(TaskFile *f, long *count);
+
+// Dispatch Arrivals Function
+// This function delivers every timed task at its arrival time, measured from start.
+void dispatchArrivals(TaskFile *f, const struct timespec *start);
+
+// Close Task File Function
+void closeTaskFile(TaskFile *f);
+
+// Execute Slice Function
+// This function runs one slice of a task like executeJob, without sleeping for it.
+void executeSlice(Task *task, WorkBalancerQueue *my_queue, int my_id);
+
+// Prepare Virtual Function
+// This function sizes the queues for the loaded tasks and the event heap of runVirtual up front,
+// so the run itself rarely allocates. Call it after loading, before runVirtual.
+void prepareVirtual();
+
+// Run Virtual Function
+// This function runs the loaded tasks against a discrete-event clock instead of threads.
+// The timed tasks are delivered when the clock reaches their arrival.
+// Returns the makespan in simulated milliseconds.
+double runVirtual(unsigned long long seed, const Arrival *arrivals, long arrival_count);
+
 // Process Jobs Function
 // This function is used to process the jobs.
 void *processJobs(void *arg);
 
+// Wake Idle Worker Function
+// This function wakes one parked worker if q is above the high watermark.
+// Called after submitting to q; returns at once when no worker is parked.
+void wakeIdleWorker(WorkBalancerQueue *q);
+
+// Wake All Workers Function
+// This function wakes every parked worker, used to deliver stop_threads.
+void wakeAllWorkers();
+
+// Completion Latch Functions
+// jobsRegistered adds jobs the latch waits for, jobFinished counts one down and
+// waitForAllJobs blocks until every registered job is finished.
+void jobsRegistered(int n);
+void jobFinished();
+void waitForAllJobs();
+
+// Set Run Quantum Function
+// This function lets a worker run its task for up to slices slices in a row instead of requeueing
+// it after each one, see Run To Quantum in simulator.c. 1 (default) requeues after every slice.
+void setRunQuantum(int slices);
+
+// Set Victim Policy Function
+// This function selects how thieves pick victims: local, neighbor, random or largest.
+// Returns 0 for an unknown name. Call before the threads are started.
+int setVictimPolicy(const char *name);
+
+// Get Steals From Function
+// This function returns the number of steals taken from the given core's queue.
+long getStealsFrom(int victim);
+
+// Histogram of durations in us, HDR style:
+// values below HIST_SUB_BUCKETS are exact, above that every power of two is split into
+// HIST_SUB_BUCKETS linear buckets, so a recorded value is off by at most 1/HIST_SUB_BUCKETS
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40 // Larger values (about 12 days) are clamped
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+typedef struct Histogram
+{
+    long count;
+    long long sum, max;
+    long buckets[HIST_BUCKETS];
+} Histogram;
+
+// This struct holds the metrics of one core, written only by that core's worker.
+// Read after the threads are joined, so the hot path needs no atomics.
+typedef struct CoreMetrics
+{
+    _Alignas(CACHE_LINE) long long busy_us; // Time spent executing slices
+    long long idle_us;                       // Time spent parked
+    long local_fetches;                      // Tasks taken from the own queue
+    long steal_attempts;                     // Batch steals tried on a victim above the high watermark
+    long steals;                             // Batch steals that got a task
+    long migrations;                         // Slices run on another core than the previous one
+    long long migration_cost_us;             // Work lost to those migrations, see migrationCost
+    long requeues;                           // Unfinished tasks put back into the queue after a slice
+    long continued;                          // Slices run right after the previous one, no requeue
+    Histogram queueing;                      // Per task: time spent waiting in queues
+    Histogram response;                      // Per task: arrival to first slice
+    Histogram turnaround;                    // Per task: arrival to finish
+} CoreMetrics;
+
+// Start Metrics Function
+// This function resets the clock of the metrics, the virtual clock when virtual is set.
+void startMetrics(int virtual);
+
+// Set Virtual Time Function
+// This function advances the virtual clock to now_us.
+void setVirtualTime(long long now_us);
+
+// Metrics Now Function
+// This function returns the time in us since startMetrics, real or virtual.
+long long metricsNow();
+
+// Task Lifecycle Functions
+// taskArrived stamps a task entering the system, taskStarted a slice starting on a core,
+// taskRequeued the task going back to a queue and taskFinished its last slice ending.
+// Each only touches the task and the calling core's metrics.
+void taskArrived(Task *task, long long now_us);
+void taskStarted(int core, Task *task, long long now_us);
+void taskRequeued(Task *task, long long now_us);
+void taskFinished(int core, Task *task, long long now_us);
+
+// Write Metrics Function
+// This function merges the per-core metrics and writes them to <prefix>.json and <prefix>.csv.
+// Returns 0 if a file cannot be written.
+int writeMetrics(const char *prefix, double makespan_ms);
+
+// Print Migration Summary Function
+// This function prints the migrations and the work they lost, then the requeues and the ones run to quantum skipped.
+void printMigrationSummary(FILE *f);
+
+// Print Latency Summary Function
+// This function prints the merged latency percentiles of all tasks in one line.
+void printLatencySummary(FILE *f);
+
+// Slice log modes: per-core rings printed by a drainer thread, direct printf, or no log
+enum
+{
+    LOG_RINGS,
+    LOG_STDIO,
+    LOG_OFF
+};
+
+// Start Log Function
+// This function selects the log mode and starts the drainer. In virtual mode there is no
+// drainer, the rings are printed when one is full and by stopLog.
+void startLog(int mode, int virtual);
+
+// Stop Log Function
+// This function stops the drainer and prints every remaining record. The workers must be done logging.
+void stopLog();
+
+// Log Parked Function
+// This function marks a core as parked (or not), a parked core does not hold the drainer back.
+void logParked(int core, int parked);
+
+// Log Slice Function
+// This function records the line executeJob prints for a slice: Executed, or Finished when finished is set.
+// Only the worker of the core may log to it.
+void logSlice(int core, const Task *task, double ms, int finished);
+
 // Initialize Shared Variables Function
 // This function is used to initialize the shared variables.
 void initSharedVariables();
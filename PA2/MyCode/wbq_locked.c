@@ -0,0 +1,210 @@
+// Barış Pome - CS307 - Operating Systems Course - Fall 2024-2025
+// This is wbq_locked.c file
+// The original mutex-protected queue, kept as the baseline backend of bench_queue
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "wbq_locked.h"
+
+// Initialize queue with thread-safe properties
+// - Sets up atomic pointers and counter
+// - Initializes synchronization primitives
+void LockedQueue_Init(LockedQueue *q)
+{
+    atomic_store(&q->head, NULL);
+    atomic_store(&q->tail, NULL);
+    atomic_store(&q->count, 0);
+    pthread_mutex_init(&q->lock, NULL);
+}
+
+// Free the nodes left in the queue
+void LockedQueue_Destroy(LockedQueue *q)
+{
+    LockedQueueNode *node = atomic_load(&q->head);
+    while (node != NULL)
+    {
+        LockedQueueNode *next = atomic_load(&node->next);
+        free(node);
+        node = next;
+    }
+    atomic_store(&q->head, NULL);
+    atomic_store(&q->tail, NULL);
+    atomic_store(&q->count, 0);
+    pthread_mutex_destroy(&q->lock);
+}
+
+// Task submission with cache and thread safety considerations
+// Performance characteristics:
+// - Cache affinity: Tasks start in their original queue
+// - Synchronization: Mutex + atomic operations
+// - Load tracking: Atomic counter increment
+void lockedSubmitTask(LockedQueue *q, Task *_task)
+{
+    LockedQueueNode *node = malloc(sizeof(LockedQueueNode));
+    node->task = _task;
+    atomic_store(&node->next, NULL);
+
+    pthread_mutex_lock(&q->lock);
+    if (atomic_load(&q->tail) == NULL) // If the queue is empty
+    {
+        atomic_store(&q->head, node); // Set the head to the new node
+        atomic_store(&q->tail, node); // Set the tail to the new node
+    }
+    else
+    {
+        atomic_store(&atomic_load(&q->tail)->next, node); // Set the next of the tail to the new node
+        atomic_store(&q->tail, node);                     // Set the tail to the new node
+    }
+    atomic_fetch_add(&q->count, 1); // Increment the count of the queue
+    pthread_mutex_unlock(&q->lock); // Unlock the mutex
+}
+
+// Local task fetching
+// - Thread-safe task removal from the head
+Task *lockedFetchTask(LockedQueue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    LockedQueueNode *node = atomic_load(&q->head); // Load the head of the queue
+    Task *task = NULL;
+
+    if (node != NULL)
+    {
+        task = node->task;
+        atomic_store(&q->head, atomic_load(&node->next)); // Set the head to the next node
+        if (atomic_load(&q->head) == NULL)
+        {
+            atomic_store(&q->tail, NULL);
+        }
+        free(node);
+        atomic_fetch_sub(&q->count, 1); // Decrement the count of the queue
+    }
+
+    pthread_mutex_unlock(&q->lock);
+    return task;
+}
+
+// Batch submission
+// - The chain is built before taking the lock, the critical section only links it at the tail
+// - The count grows by n at once, so stealers never see a partial batch
+void lockedSubmitTasks(LockedQueue *q, Task **tasks, int n)
+{
+    if (n <= 0)
+    {
+        return;
+    }
+    LockedQueueNode *first = NULL, *last = NULL;
+    for (int i = 0; i < n; i++)
+    {
+        LockedQueueNode *node = malloc(sizeof(LockedQueueNode));
+        node->task = tasks[i];
+        atomic_store(&node->next, NULL);
+        if (last == NULL)
+            first = node;
+        else
+            atomic_store(&last->next, node);
+        last = node;
+    }
+
+    pthread_mutex_lock(&q->lock);
+    if (atomic_load(&q->tail) == NULL) // If the queue is empty
+    {
+        atomic_store(&q->head, first);
+    }
+    else
+    {
+        atomic_store(&atomic_load(&q->tail)->next, first);
+    }
+    atomic_store(&q->tail, last);
+    atomic_fetch_add(&q->count, n);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Work stealing implementation
+// Design considerations:
+// - Steals the second node
+// - Queue Preservation: Leaves minimum tasks in source queue
+Task *lockedFetchTaskFromOthers(LockedQueue *q)
+{
+    pthread_mutex_lock(&q->lock);
+
+    if (atomic_load(&q->count) <= 1) // If the queue has only one task or is empty
+    {                                // Leave at least one task
+        pthread_mutex_unlock(&q->lock);
+        return NULL;
+    }
+
+    LockedQueueNode *first = atomic_load(&q->head);
+    LockedQueueNode *second = atomic_load(&first->next);
+
+    Task *task = second->task;
+    atomic_store(&first->next, atomic_load(&second->next)); // Set the next of the first node to the next of the second node
+
+    if (second == atomic_load(&q->tail)) // If the second node is the tail of the queue
+    {
+        atomic_store(&q->tail, first);
+    }
+
+    atomic_fetch_sub(&q->count, 1); // Decrement the count of the queue
+    free(second);                   // Free the second node
+
+    pthread_mutex_unlock(&q->lock);
+    return task;
+}
+
+// Batch work stealing, the counterpart of fetchHalfFromOthers
+// - The oldest half of the victim is detached in one critical section, the victim keeps at least one task
+// - The detached nodes are reused: all but the first are linked at the thief's tail, no malloc or free for them
+// - The two mutexes are never held together
+Task *lockedFetchHalfFromOthers(LockedQueue *q, LockedQueue *my_queue)
+{
+    pthread_mutex_lock(&q->lock);
+    int n = atomic_load(&q->count) / 2;
+    if (n > STEAL_BATCH_MAX)
+    {
+        n = STEAL_BATCH_MAX;
+    }
+    if (n <= 0) // Only one task or empty
+    {
+        pthread_mutex_unlock(&q->lock);
+        return NULL;
+    }
+
+    LockedQueueNode *first = atomic_load(&q->head);
+    LockedQueueNode *last = first;
+    for (int i = 1; i < n; i++)
+    {
+        last = atomic_load(&last->next);
+    }
+    atomic_store(&q->head, atomic_load(&last->next)); // At least one node is left, the tail does not move
+    atomic_store(&last->next, NULL);                  // Cut the detached chain
+    atomic_fetch_sub(&q->count, n);
+    pthread_mutex_unlock(&q->lock);
+
+    Task *task = first->task;
+    LockedQueueNode *rest = atomic_load(&first->next);
+    free(first);
+    if (rest != NULL) // Keep the rest in the thief's queue
+    {
+        pthread_mutex_lock(&my_queue->lock);
+        if (atomic_load(&my_queue->tail) == NULL)
+        {
+            atomic_store(&my_queue->head, rest);
+        }
+        else
+        {
+            atomic_store(&atomic_load(&my_queue->tail)->next, rest);
+        }
+        atomic_store(&my_queue->tail, last);
+        atomic_fetch_add(&my_queue->count, n - 1);
+        pthread_mutex_unlock(&my_queue->lock);
+    }
+    return task;
+}
+
+// O(1) queue size check, no lock
+int getLockedQueueSize(LockedQueue *q)
+{
+    return atomic_load(&q->count); // Return the count of the queue
+}
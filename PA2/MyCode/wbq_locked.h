@@ -0,0 +1,64 @@
+// Barış Pome - CS307 - Operating Systems Course - Fall 2024-2025
+// This is header file wbq_locked.h
+
+#ifndef WBQ_LOCKED_H
+#define WBQ_LOCKED_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include "wbq.h"
+
+// Mutex-protected linked list queue, the first design of WorkBalancerQueue.
+// Not used by the simulator, kept as the baseline backend of bench_queue:
+// 1. Synchronization: One mutex per queue around every change
+// 2. Memory: One node allocated per submit and freed per fetch
+// 3. Load balancing: Atomic counter for O(1) size checks
+
+// This struct is used to create the nodes of the queue.
+typedef struct LockedQueueNode
+{
+    Task *task;
+    _Atomic(struct LockedQueueNode *) next;
+} LockedQueueNode;
+
+// This struct is used to create the queue.
+typedef struct LockedQueue
+{
+    _Atomic(LockedQueueNode *) head; // Atomic pointer for thread-safe access
+    _Atomic(LockedQueueNode *) tail; // Atomic pointer for thread-safe access
+    _Atomic int count;               // O(1) size tracking for load balancing decisions
+    pthread_mutex_t lock;            // Coarse-grained lock for complex operations
+} LockedQueue;
+
+// Initialize Locked Queue Function
+void LockedQueue_Init(LockedQueue *q);
+
+// Destroy Locked Queue Function
+// This function frees the nodes still in the queue. No other thread may use the queue anymore.
+void LockedQueue_Destroy(LockedQueue *q);
+
+// Locked Submit Task Function
+// lockedSubmitTask: O(1), a malloc and the mutex. Any thread may submit.
+void lockedSubmitTask(LockedQueue *q, Task *_task);
+
+// Locked Fetch Task Function
+// lockedFetchTask: O(1), takes the head under the mutex and frees its node.
+Task *lockedFetchTask(LockedQueue *q);
+
+// Locked Submit Tasks Function
+// lockedSubmitTasks: n nodes are allocated and linked outside the lock, appended under one acquisition.
+void lockedSubmitTasks(LockedQueue *q, Task **tasks, int n);
+
+// Locked Fetch Task From Others Function
+// lockedFetchTaskFromOthers: Takes the second node, leaving at least one task in the queue.
+Task *lockedFetchTaskFromOthers(LockedQueue *q);
+
+// Locked Fetch Half From Others Function
+// lockedFetchHalfFromOthers: Detaches half of q's nodes (at most STEAL_BATCH_MAX) from the head under q's mutex,
+// leaving at least one task. Returns the first task, the rest are appended to my_queue under its mutex.
+Task *lockedFetchHalfFromOthers(LockedQueue *q, LockedQueue *my_queue);
+
+// Get Locked Queue Size Function
+int getLockedQueueSize(LockedQueue *q);
+
+#endif
@@ -1,7 +1,8 @@
 #ifndef CONSTANTS_H
 #define CONSTANTS_H
 
-#define NUM_CORES 8
+#define NUM_CORES 8  // Default number of cores, -c changes it at startup
+#define MAX_CORES 64 // Upper bound of the number of cores
 #define CYCLE 200
 #define CACHE_FACTOR 0.05
 #define MAX_CACHE_FACTOR 4.0
@@ -15,12 +15,13 @@
 // execution while your threads run.
 
 //shared vars
-int stop_threads = 0;
-int finished_jobs[NUM_CORES];
+atomic_int stop_threads = 0;
+CoreCounter finished_jobs[MAX_CORES];
+int num_cores = NUM_CORES;
 WorkBalancerQueue** processor_queues;
 
-// Simulate task execution
-void executeJob(Task* task, WorkBalancerQueue* my_queue, int my_id ) {
+// Simulate one slice of task execution, without the sleep
+void executeSlice(Task* task, WorkBalancerQueue* my_queue, int my_id ) {
     // Update task's affinity and owner thread 
     // if it was recently acquired by another thread
     if (task -> owner != my_queue) {
@@ -31,15 +32,24 @@ void executeJob(Task* task, WorkBalancerQueue* my_queue, int my_id ) {
     // If the next execution finishes the task, set its remaining time to 0
     // Notify the main thread that a job was finished by updating finished_jobs.
     // Else, update cache factor and duration accordingly.
-    if (task -> task_duration - (CYCLE * task -> cache_warmed_up) <= 0) {
+    // The remaining time is kept in whole ms, less than 1 ms left also finishes the task.
+    int remaining = task -> task_duration - (CYCLE * task -> cache_warmed_up);
+    if (remaining <= 0) {
         task -> task_duration = 0;
-        printf("Processor %d: Finished task %s\n", my_id, task -> task_id);
-        finished_jobs[my_id]++;
+        logSlice(my_id, task, 0, 1);
+        finished_jobs[my_id].count++;
+        jobFinished();
     } else {
-        task -> task_duration -= CYCLE * task -> cache_warmed_up;
-        printf("Processor %d: Executed task %s for %.2f ms\n", my_id, task -> task_id, CYCLE * task -> cache_warmed_up);
+        task -> task_duration = remaining;
+        logSlice(my_id, task, CYCLE * task -> cache_warmed_up, 0);
         if (task -> cache_warmed_up < MAX_CACHE_FACTOR ) task -> cache_warmed_up += CACHE_FACTOR;
     }
+    finished_jobs[my_id].slices++;
+}
+
+// Simulate task execution
+void executeJob(Task* task, WorkBalancerQueue* my_queue, int my_id ) {
+    executeSlice(task, my_queue, my_id);
 
     // Sleep for one simulate CPU cycle
     usleep(CYCLE * 1000);
@@ -48,110 +58,166 @@ void executeJob(Task* task, WorkBalancerQueue* my_queue, int my_id ) {
 // Check if sufficient number of jobs were finished.
 int all_jobs_finished(int registered_jobs) {
     int sum = 0;
-    for (int i = 0; i < NUM_CORES; i++) {
-        sum += finished_jobs[i];
+    for (int i = 0; i < num_cores; i++) {
+        sum += finished_jobs[i].count;
     }
     return sum >= registered_jobs;
 }
 
 int main(int argc, char* argv[]) {
     // Parse command line arguments
-    if (argc != 2) {
-        fprintf(stderr, "Incorrect call, usage: %s <filename>\n", argv[0]);
+    // -c <n> runs n cores, -c file runs one core per line of the input file
+    // -s <policy> picks steal victims: local, neighbor, random or largest
+    // -v <seed> runs in virtual time, a discrete-event clock instead of threads sleeping
+    // -m <prefix> writes the scheduler metrics to <prefix>.json and <prefix>.csv
+    // -l ring|stdio|off logs slices through per-core rings (default), printf, or not at all
+    // -a off steals the top of the victim regardless of cache warmth
+    // -r <slices> runs a task for up to that many slices in a row before requeueing it
+    char* filename = NULL;
+    char* cores_arg = NULL;
+    char* virtual_seed = NULL;
+    char* metrics_prefix = NULL;
+    int log_mode = LOG_RINGS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) cores_arg = argv[++i];
+        else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) virtual_seed = argv[++i];
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) metrics_prefix = argv[++i];
+        else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) setAffinityStealing(strcmp(argv[++i], "off") != 0);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) setRunQuantum(atoi(argv[++i]));
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "ring") == 0) log_mode = LOG_RINGS;
+            else if (strcmp(argv[i], "stdio") == 0) log_mode = LOG_STDIO;
+            else if (strcmp(argv[i], "off") == 0) log_mode = LOG_OFF;
+            else { filename = NULL; break; }
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            if (!setVictimPolicy(argv[++i])) { filename = NULL; break; }
+        }
+        else if (filename == NULL) filename = argv[i];
+        else { filename = NULL; break; } // More than one file
+    }
+    if (filename == NULL) {
+        fprintf(stderr, "Incorrect call, usage: %s [-c <cores>|-c file] [-s local|neighbor|random|largest] [-v <seed>] [-m <prefix>] [-l ring|stdio|off] [-a on|off] [-r <slices>] <filename>\n", argv[0]);
         return 1;
     }
-    
-    char* filename = argv[1];
 
     // Try to open the input file
-    FILE *file = fopen(filename, "r");
+    // The file is mapped and parsed in parallel by the task loader, see task_loader.c
+    TaskFile *file = openTaskFile(filename);
     if (file == NULL) {
         printf("Couldn't open file , terminating. . .\n");
         return -1;
     }
 
+    // Choose the number of cores, every line of the file needs its own core
+    int file_lines = getTaskFileLines(file);
+    if (cores_arg != NULL) num_cores = strcmp(cores_arg, "file") == 0 ? file_lines : atoi(cores_arg);
+    if (num_cores < 1 || num_cores > MAX_CORES || file_lines > num_cores) {
+        fprintf(stderr, "Cannot run %d lines of tasks on %d cores (at most %d).\n", file_lines, num_cores, MAX_CORES);
+        closeTaskFile(file);
+        return 1;
+    }
 
     // Initialize shared variables, call the student's function as well.
-    processor_queues = malloc(NUM_CORES * sizeof(WorkBalancerQueue*));
-    for (int i = 0; i < NUM_CORES; i++) {
-        processor_queues[i] = malloc(sizeof(WorkBalancerQueue));
-        finished_jobs[i] = 0;
+    // The queues and task pools are allocated by initSharedVariables, each one from its worker's CPU.
+    processor_queues = malloc(num_cores * sizeof(WorkBalancerQueue*));
+    for (int i = 0; i < num_cores; i++) {
+        finished_jobs[i].count = 0;
+        finished_jobs[i].slices = 0;
+        reserveTaskPool(i, getTaskFileLineTasks(file, i)); // Carved on the core's CPU by initSharedVariables
     }
     initSharedVariables();
 
-    printf("Initialized %d processor_queues\n", NUM_CORES);
-
-    
-    // Parse input file
-    char line[1024];
-    int processor_index = 0;
-    int registered_jobs = 0;
-    int max_runtime = INT_MIN;
-    while (fgets(line, sizeof(line), file)) { 
-        int core_runtime = 0;
-        int num;
-        char *token = strtok(line, " ");  
-        while (token != NULL) {
-            char string_part[1024];
-            int num;
-
-            if (sscanf(token, "%[^-]-%d", string_part, &num) == 2) {
-                Task* my_task = malloc(sizeof(Task));
-                my_task -> task_id = strdup(string_part);
-                my_task -> task_duration = num;
-                my_task -> cache_warmed_up = 1.0;
-                my_task -> owner = processor_queues[processor_index];
-                core_runtime += num;
-                submitTask(processor_queues[processor_index], my_task);
-                registered_jobs++;
+    printf("Initialized %d processor_queues\n", num_cores);
+
+    // The loader holds one job of the latch until every task of the file is registered
+    jobsRegistered(1);
+    startMetrics(virtual_seed != NULL);
+    double makespan;
+    long loading_allocations;
+    if (virtual_seed != NULL) {
+        // Same scheduling on a simulated clock, no threads
+        // Everything is parsed first, timed tasks arrive on the simulated clock
+        loadTaskFile(file);
+        jobFinished();
+        prepareVirtual();
+        printf("Read file, starting multithreaded execution\n");
+        loading_allocations = getAllocationCount();
+        setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+        long arrival_count;
+        const Arrival *arrivals = getArrivals(file, &arrival_count);
+        startLog(log_mode, 1);
+        makespan = runVirtual(strtoull(virtual_seed, NULL, 10), arrivals, arrival_count);
+        stopLog();
+        printf("All tasks finished, joining threads\n");
+    } else {
+        // Start threads, tasks are delivered to them while the file is parsed
+        printf("Read file, starting multithreaded execution\n");
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        startLog(log_mode, 0);
+        pthread_t* processor_ids = malloc(num_cores * sizeof(pthread_t));
+        for (int i = 0; i < num_cores; i++) {
+            ThreadArguments* arg = malloc(sizeof(ThreadArguments));
+            arg -> q = processor_queues[i];
+            arg -> id = i;
+            int rc = pthread_create(&processor_ids[i], NULL, &processJobs, arg);
+            if (rc) {
+                printf("Error creating thread, terminating. . . ");
+                return -1;
             }
-
-            token = strtok(NULL, " "); 
         }
-        if (core_runtime > max_runtime) max_runtime = core_runtime;
-        processor_index++;
-    }
 
-    fclose(file);
-    printf("Read file, starting multithreaded execution\n");
-    // To print the initial state of cores after tasks are distributed
-    // printf("Initial state of cores:\n");
-    // for (int i = 0; i < NUM_CORES; i++) {
-    //     printf("Core %d: ", i);
-    //     print_queue(processor_queues[i]);
-    // }
-    // printf("---------------------------------------------\n");
-
-    // Start threads
-    pthread_t processor_ids[NUM_CORES];
-    for (int i = 0; i < NUM_CORES; i++) {
-        ThreadArguments* arg = malloc(sizeof(ThreadArguments));
-        arg -> q = processor_queues[i];
-        arg -> id = i;
-        int rc = pthread_create(&processor_ids[i], NULL, &processJobs, arg);
-        if (rc) {
-            printf("Error creating thread, terminating. . . ");
-            return -1;
+        loadTaskFile(file);
+        loading_allocations = getAllocationCount();
+        dispatchArrivals(file, &start);
+        jobFinished();
+
+        // Sleep until tasks are finished, the last finished job wakes us up
+        waitForAllJobs();
+        stopLog(); // Every slice is logged before its job is counted as finished
+
+        atomic_store(&stop_threads, 1);
+        wakeAllWorkers();
+
+        printf("All tasks finished, joining threads\n");
+
+        for (int i = 0; i < num_cores; i++) {
+            pthread_join(processor_ids[i], NULL);
         }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        makespan = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
     }
+    closeTaskFile(file);
 
-    // Sleep until tasks are finished
-    // If you want to debug, you can uncomment this print block
-    // to see a snapshot of the state of your queues, implement a print_queue method first
-    while (!all_jobs_finished(registered_jobs)) {
-        // for (int i = 0; i < NUM_CORES; i++) {
-        //     printf("Core %d: ", i);
-        //     print_queue(processor_queues[i]);
-        // }
-        usleep(2000 * 1000);
+    long slices = 0;
+    for (int i = 0; i < num_cores; i++) {
+        slices += finished_jobs[i].slices;
     }
+    fprintf(stderr, "Makespan: %.1f ms, utilization: %.1f%%\n", makespan,
+            makespan > 0 ? 100.0 * slices * CYCLE / (num_cores * makespan) : 0.0);
 
-    stop_threads = 1;
+    fprintf(stderr, "Heap allocations after loading: %ld\n", getAllocationCount() - loading_allocations);
 
-    printf("All tasks finished, joining threads\n");
+    long steal_ops = 0, tasks_stolen = 0, tasks_returned = 0;
+    for (int i = 0; i < num_cores; i++) {
+        steal_ops += processor_queues[i] -> steal_ops;
+        tasks_stolen += processor_queues[i] -> tasks_stolen;
+        tasks_returned += processor_queues[i] -> tasks_returned;
+    }
+    fprintf(stderr, "Steals: %ld, tasks moved: %ld (%.2f per steal), left warm: %ld\n", steal_ops, tasks_stolen,
+            steal_ops ? (double)tasks_stolen / steal_ops : 0.0, tasks_returned);
+    fprintf(stderr, "Steals per victim:");
+    for (int i = 0; i < num_cores; i++) {
+        fprintf(stderr, " %ld", getStealsFrom(i));
+    }
+    fprintf(stderr, "\n");
 
-    for (int i = 0; i < NUM_CORES; i++) {
-        pthread_join(processor_ids[i], NULL);
+    printMigrationSummary(stderr);
+    printLatencySummary(stderr);
+    if (metrics_prefix != NULL && !writeMetrics(metrics_prefix, makespan)) {
+        fprintf(stderr, "Cannot write metrics to %s.json and %s.csv\n", metrics_prefix, metrics_prefix);
     }
 
     return 0;
@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <time.h>
 
 // This program enablues you to create a sample task input document
@@ -14,6 +16,11 @@
 // we write ret = rand() % (400 - 50 + 1) + 50
 // the % 100 line is there to round down last two digits. 
 
+// Run without arguments, the program asks for the numbers as before.
+// With flags it runs non-interactively and reproducibly (see usage() below):
+// task durations follow a chosen distribution, lines can get skewed task counts
+// and tasks can carry an arrival time, written as ID-dur@ms.
+
 // Function to generate heavy tasks (between 2000 and 5000)
 int generate_heavy_task() {
     int ret = rand() % (5000 - 2000 + 1) + 2000;
@@ -57,7 +64,174 @@ void generate_tasks(int n, int min_entries_per_line, int max_entries_per_line) {
     fclose(file);
 }
 
-int main() {
+// Fast PRNG (xorshift64*), the same sequence for a seed on every platform
+static unsigned long long rng_state;
+
+void seed_random(unsigned long long seed) {
+    // splitmix64 step, so that small seeds give well mixed, nonzero states
+    unsigned long long z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    rng_state = (z ^ (z >> 31)) | 1;
+}
+
+unsigned long long next_random() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+// Uniform in (0, 1]
+double random_unit() {
+    return ((next_random() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+enum { DIST_UNIFORM, DIST_BIMODAL, DIST_PARETO, DIST_LOGNORMAL };
+
+// Draw a duration with the given mean (ms).
+// uniform: [0, 2 * mean]
+// bimodal: half light [0.2, 0.8] * mean, half heavy [1.2, 1.8] * mean, like the heavy/light mix above
+// pareto: shape alpha, scale chosen so that the mean is kept (alpha > 1)
+// lognormal: shape sigma, mu chosen so that the mean is kept
+double draw_duration(int dist, double mean, double shape) {
+    switch (dist) {
+    case DIST_UNIFORM:
+        return 2 * mean * random_unit();
+    case DIST_BIMODAL:
+        if (next_random() & 1) return mean * (0.2 + 0.6 * random_unit());
+        return mean * (1.2 + 0.6 * random_unit());
+    case DIST_PARETO:
+        return mean * (shape - 1) / shape / pow(random_unit(), 1.0 / shape);
+    default: { // Box-Muller
+        double normal = sqrt(-2 * log(random_unit())) * cos(2 * M_PI * random_unit());
+        return exp(log(mean) - shape * shape / 2 + shape * normal);
+    }
+    }
+}
+
+// Durations are whole multiples of 100 ms like the interactive generator, at least 100 ms.
+// They are rounded to the nearest multiple so the mean is kept.
+int round_duration(double duration) {
+    if (duration > 1e9) duration = 1e9;
+    int ret = (int)(duration + 50);
+    ret -= ret % 100;
+    return ret < 100 ? 100 : ret;
+}
+
+// Split tasks over lines, line i weighing 1 / (i + 1)^skew (0 is an even split).
+// Largest remainders get the leftover tasks so the total is exact.
+void split_tasks(long tasks, int lines, double skew, long *counts) {
+    double total = 0;
+    double *share = malloc(lines * sizeof(double));
+    for (int i = 0; i < lines; i++) total += share[i] = pow(i + 1, -skew);
+    long given = 0;
+    for (int i = 0; i < lines; i++) {
+        share[i] = share[i] / total * tasks;
+        counts[i] = (long)share[i];
+        share[i] -= counts[i];
+        given += counts[i];
+    }
+    for (; given < tasks; given++) {
+        int best = 0;
+        for (int i = 1; i < lines; i++) if (share[i] > share[best]) best = i;
+        counts[best]++;
+        share[best] = -1;
+    }
+    free(share);
+}
+
+void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-c cores] [-n tasks] [-d uniform|bimodal|pareto|lognormal] [-m mean_ms]\n"
+            "          [-x shape] [-k skew] [-s seed] [-a span_ms] [-o file]\n"
+            "  -c  lines of the file, one per core (default 8)\n"
+            "  -n  total number of tasks (default 64)\n"
+            "  -d  duration distribution (default bimodal)\n"
+            "  -m  mean duration in ms (default 2000)\n"
+            "  -x  pareto alpha (default 1.5) or lognormal sigma (default 1.0)\n"
+            "  -k  per-core skew, line i gets tasks in proportion to 1/(i+1)^skew (default 0)\n"
+            "  -s  seed, the same flags and seed give the same file (default 1)\n"
+            "  -a  give every task an arrival uniformly in [0, span_ms], written as ID-dur@ms\n"
+            "  -o  output file, - for stdout (default tasks.txt)\n"
+            "Without arguments the numbers are asked for interactively.\n", name);
+}
+
+// Non-interactive generation from flags
+int generate_from_flags(int argc, char *argv[]) {
+    int lines = 8, dist = DIST_BIMODAL;
+    long tasks = 64, span = -1;
+    double mean = 2000, shape = -1, skew = 0;
+    unsigned long long seed = 1;
+    const char *output = "tasks.txt";
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+            usage(argv[0]);
+            return 1;
+        }
+        switch (argv[i][1]) {
+        case 'c': lines = atoi(value); break;
+        case 'n': tasks = atol(value); break;
+        case 'm': mean = atof(value); break;
+        case 'x': shape = atof(value); break;
+        case 'k': skew = atof(value); break;
+        case 's': seed = strtoull(value, NULL, 10); break;
+        case 'a': span = atol(value); break;
+        case 'o': output = value; break;
+        case 'd':
+            if (strcmp(value, "uniform") == 0) dist = DIST_UNIFORM;
+            else if (strcmp(value, "bimodal") == 0) dist = DIST_BIMODAL;
+            else if (strcmp(value, "pareto") == 0) dist = DIST_PARETO;
+            else if (strcmp(value, "lognormal") == 0) dist = DIST_LOGNORMAL;
+            else { usage(argv[0]); return 1; }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    if (shape < 0) shape = dist == DIST_PARETO ? 1.5 : 1.0;
+    if (lines < 1 || tasks < 0 || mean <= 0 || skew < 0 || (dist == DIST_PARETO && shape <= 1) || shape <= 0) {
+        fprintf(stderr, "Invalid parameters: need cores >= 1, tasks >= 0, mean > 0, skew >= 0 and shape > 0 (> 1 for pareto)\n");
+        return 1;
+    }
+
+    FILE *file = strcmp(output, "-") == 0 ? stdout : fopen(output, "w");
+    if (file == NULL) {
+        perror("Error opening file");
+        return 1;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    seed_random(seed);
+    long *counts = malloc(lines * sizeof(long));
+    split_tasks(tasks, lines, skew, counts);
+    for (int i = 0; i < lines; i++) {
+        // Names are C<line>T<task>, unique for any number of lines
+        for (long j = 1; j <= counts[i]; j++) {
+            fprintf(file, "%sC%dT%ld-%d", j > 1 ? " " : "", i, j, round_duration(draw_duration(dist, mean, shape)));
+            if (span >= 0) fprintf(file, "@%lld", (long long)(random_unit() * span));
+        }
+        fprintf(file, "\n");
+    }
+    free(counts);
+
+    if (file != stdout && fclose(file) != 0) {
+        perror("Error writing file");
+        return 1;
+    }
+    fprintf(stderr, "%ld tasks on %d lines written to %s\n", tasks, lines, output);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        return generate_from_flags(argc, argv);
+    }
+
     srand(time(NULL)); // Seed for random number generation
 
     int n, min_entries_per_line, max_entries_per_line;
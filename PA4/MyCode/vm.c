@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "vm_dbg.h"
+#include "vm_trace.h"
 
 #define NOPS (16)
 
@@ -28,10 +29,31 @@
 #define PAGE_SIZE (4096)   // Page size in bytes
 #define OS_MEM_SIZE (2)    // OS Region size. Also the start of the page tables' page
 #define Cur_Proc_ID (0)    // id of the current process
-#define Proc_Count (1)     // total number of processes, including ones that finished executing.
+#define Proc_Count (1)     // number of PCB slots in use, including halted ones waiting to be reused.
 #define OS_STATUS (2)      // Bit 0 shows whether the PCB list is full or not
 #define OS_FREE_BITMAP (3) // Bitmap for free pages
 
+// Page tables are 64 words apart, 32 to a frame. Frame 2 holds the tables of pids 0-31; frames for the
+// later groups of 32 pids are taken from the free frames on demand and given back once the group is empty.
+#define PT_STRIDE (64)
+#define PT_PER_FRAME (FRAME_SIZE / PT_STRIDE)
+#define PT_FRAME_LIMIT (32) // page table frames must be below this so their addresses fit the 16-bit PTBR
+
+// Physical memory configuration. The guest virtual address space stays 16-bit (32 pages of 2048 words),
+// but the machine can have up to 2048 frames. Build with -DPHYS_FRAMES=<n> (a multiple of 16) to change it.
+#ifndef PHYS_FRAMES
+#define PHYS_FRAMES (32)
+#endif
+#define FRAME_SIZE (2048)                          // Frame size in words
+#define PHYS_MEM_SIZE (PHYS_FRAMES * FRAME_SIZE)   // Physical memory size in words
+#define BITMAP_WORDS (PHYS_FRAMES / 16)            // Free bitmap words starting at OS_FREE_BITMAP
+#define OS_FRAMES (3)                              // Frames 0-1 hold the OS region, frame 2 the page tables
+#define PCB_BASE (OS_FREE_BITMAP + BITMAP_WORDS > 12 ? OS_FREE_BITMAP + BITMAP_WORDS : 12) // Start of the PCB list
+
+#if PHYS_FRAMES % 16 != 0 || PHYS_FRAMES < 32 || PHYS_FRAMES > 2048
+#error "PHYS_FRAMES must be a multiple of 16 between 32 and 2048"
+#endif
+
 // Process list and PCB related constants
 #define PCB_SIZE (3) // Number of fields in a PCB
 #define PID_PCB (0)  // Holds the pid for a process
@@ -41,7 +63,37 @@
 #define CODE_SIZE (2)      // Number of pages for the code segment
 #define HEAP_INIT_SIZE (2) // Number of pages for the heap segment initially
 
+// Page table entry layout: bit 0 valid, bit 1 read, bit 2 write, bit 3 referenced, bit 4 dirty,
+// bits 11-15 the low 5 bits of the frame number and bits 5-10 its high 6 bits. With 32 frames the
+// high bits are always zero, so entries look exactly like the original 5-bit frame format.
+#define PTE_FRAME_HI_MASK (0x07E0)
+
+// Page table entry bits 3 and 4 are maintained by mr()/mw() for the working-set sampler
+#define PTE_REFERENCED (0x0008) // Set on every access to the page
+#define PTE_DIRTY (0x0010)      // Set on every write to the page
+
+// Working-set telemetry
+#define MAX_PROCS ((OS_MEM_SIZE * FRAME_SIZE - PCB_BASE) / PCB_SIZE) // Number of PCBs that fit in the OS region
+#define WSS_INTERVAL (1000)                              // Instructions between two working-set samples
+
+// Scheduling
+#define MLFQ_LEVELS (3)             // Number of MLFQ priority levels, 0 is the highest
+#define MLFQ_BASE_QUANTUM (50)      // Quantum of level 0 in instructions, doubled on every lower level
+#define MLFQ_BOOST_INTERVAL (10000) // Instructions between two boosts of every process back to level 0
+
+// Debugger
+#define DBG_MAX_BREAKPOINTS (64)  // Breakpoint stubs are the unused opcode 13 with the slot index in the low bits
+#define DBG_MAX_WATCHPOINTS (16)
+#define DBG_STUB (0xD000)
+
+// Performance model
+#define TLB_MAX_ENTRIES (64)
+#define COST_PC_WINDOW (CODE_SIZE * FRAME_SIZE) // per-PC cycles are kept for the code segment
+#define COST_TOP_PCS (10)                       // hottest PCs listed per process in the report
+
 bool running = true;
+bool dbg_enabled = false; // set by VM_DEBUG, enables the command loop and watchpoint checks in the fault path
+bool cost_enabled = false; // set by VM_COST, run() then uses run_costed() and mr()/mw() go through the TLB model
 
 typedef void (*op_ex_f)(uint16_t i);
 typedef void (*trp_ex_f)();
@@ -72,9 +124,13 @@ enum flags
   FN = 1 << 2
 };
 
-uint16_t mem[UINT16_MAX] = {0};
+uint16_t mem[PHYS_MEM_SIZE] = {0};
 uint16_t reg[RCNT] = {0};
 uint16_t PC_START = 0x3000;
+uint64_t icount = 0;                  // Number of instructions executed, used as the trace timestamp
+uint64_t wss_next_sample = WSS_INTERVAL; // icount at which the working-set sampler runs next
+uint64_t slice_end = UINT64_MAX;         // icount at which the running process' quantum expires
+uint64_t next_tick = WSS_INTERVAL;       // earliest of the two above, the only thing run() checks
 
 void initOS();
 int createProc(char *fname, char *hname);
@@ -87,6 +143,16 @@ static inline void tbrk();
 static inline void thalt();
 static inline void tyld();
 static inline void trap(uint16_t i);
+static inline void twss();
+void wss_sample();
+void vm_tick();
+static inline void sched_io_wait();
+static inline void dbg_break(uint16_t i);
+static inline bool dbg_watch_fault(uint16_t address, uint16_t val);
+void dbg_prompt();
+void run_costed();
+static inline void cost_access(uint16_t vpn);
+static inline void cost_switch();
 
 static inline uint16_t sext(uint16_t n, int b) { return ((n >> (b - 1)) & 1) ? (n | (0xFFFF << b)) : n; }
 static inline void uf(enum regist r)
@@ -150,8 +216,12 @@ static inline void st(uint16_t i) { mw(reg[RPC] + POFF9(i), reg[DR(i)]); }
 static inline void sti(uint16_t i) { mw(mr(reg[RPC] + POFF9(i)), reg[DR(i)]); }
 static inline void str(uint16_t i) { mw(reg[SR1(i)] + POFF(i), reg[DR(i)]); }
 static inline void rti(uint16_t i) {} // unused
-static inline void res(uint16_t i) {} // unused
-static inline void tgetc() { reg[R0] = getchar(); }
+static inline void res(uint16_t i) { dbg_break(i); } // breakpoint stub, see the Debugger section
+static inline void tgetc()
+{
+  reg[R0] = getchar();
+  sched_io_wait();
+}
 static inline void tout() { fprintf(stdout, "%c", (char)reg[R0]); }
 static inline void tputs()
 {
@@ -166,22 +236,27 @@ static inline void tin()
 {
   reg[R0] = getchar();
   fprintf(stdout, "%c", reg[R0]);
+  sched_io_wait();
 }
 static inline void tputsp() { /* Not Implemented */ }
-static inline void tinu16() { fscanf(stdin, "%hu", &reg[R0]); }
+static inline void tinu16()
+{
+  fscanf(stdin, "%hu", &reg[R0]);
+  sched_io_wait();
+}
 static inline void toutu16() { fprintf(stdout, "%hu\n", reg[R0]); }
 
-trp_ex_f trp_ex[10] = {tgetc, tout, tputs, tin, tputsp, thalt, tinu16, toutu16, tyld, tbrk};
+trp_ex_f trp_ex[11] = {tgetc, tout, tputs, tin, tputsp, thalt, tinu16, toutu16, tyld, tbrk, twss};
 static inline void trap(uint16_t i) { trp_ex[TRP(i) - trp_offset](); }
 op_ex_f op_ex[NOPS] = {/*0*/ br, add, ld, st, jsr, and, ldr, str, rti, not, ldi, sti, jmp, res, lea, trap};
 
 /**
  * Load an image file into memory.
  * @param fname the name of the file to load
- * @param offsets the offsets into memory to load the file
+ * @param offsets the physical offsets into memory to load the file
  * @param size the size of the file to load
  */
-void ld_img(char *fname, uint16_t *offsets, uint16_t size)
+void ld_img(char *fname, uint32_t *offsets, uint16_t size)
 {
   FILE *in = fopen(fname, "rb");
   if (NULL == in)
@@ -196,149 +271,1215 @@ void ld_img(char *fname, uint16_t *offsets, uint16_t size)
     uint16_t writeSize = (size - s) > PAGE_SIZE ? PAGE_SIZE : (size - s);
     fread(p, sizeof(uint16_t), (writeSize), in);
   }
-
-  fclose(in);
+
+  fclose(in);
+}
+
+void run(char *code, char *heap)
+{
+  if (dbg_enabled)
+  {
+    dbg_prompt();
+  }
+  if (cost_enabled)
+  {
+    run_costed();
+    return;
+  }
+  while (running)
+  {
+    uint16_t i = mr(reg[RPC]++);
+    op_ex[OPC(i)](i);
+    if (++icount >= next_tick)
+    {
+      vm_tick();
+    }
+  }
+}
+
+// YOUR CODE STARTS HERE
+
+// baris.pome - CS307 - PA4 - 31311
+
+// I realized that i can implement some helper functions to make the code more readable and efficient
+// Helper Functions
+
+// page_table_entry Operations
+
+// This function creates a page table entry (page_table_entry) with the given frame number, read permission, and write permission.
+static inline uint16_t create_page_table_entry(uint16_t frame_num, bool read, bool write)
+{
+  uint16_t page_table_entry = (frame_num << 11) | (frame_num & PTE_FRAME_HI_MASK) | 0x0001; // Valid bit
+  if (read)
+    page_table_entry |= 0x0002; // Read bit
+  if (write)
+    page_table_entry |= 0x0004; // Write bit
+  return page_table_entry;
+}
+
+// This function checks if a page table entry (page_table_entry) is valid.
+static inline bool is_page_valid(uint16_t page_table_entry)
+{
+  return page_table_entry & 0x0001;
+}
+
+// This function checks if a page table entry (page_table_entry) has read permission.
+static inline bool has_read_permission(uint16_t page_table_entry)
+{
+  return page_table_entry & 0x0002;
+}
+
+// This function checks if a page table entry (page_table_entry) has write permission.
+static inline bool has_write_permission(uint16_t page_table_entry)
+{
+  return page_table_entry & 0x0004;
+}
+
+// This function checks if a page table entry (page_table_entry) was accessed since the last sample.
+static inline bool is_page_referenced(uint16_t page_table_entry)
+{
+  return page_table_entry & PTE_REFERENCED;
+}
+
+// This function checks if a page table entry (page_table_entry) was written since it was allocated.
+static inline bool is_page_dirty(uint16_t page_table_entry)
+{
+  return page_table_entry & PTE_DIRTY;
+}
+
+// This function extracts the frame number from a page table entry (page_table_entry).
+static inline uint16_t get_frame_number(uint16_t page_table_entry)
+{
+  return (page_table_entry >> 11) | (page_table_entry & PTE_FRAME_HI_MASK);
+}
+
+// Bitmap Operations
+
+// This function sets a frame as used in the free bitmap. Frame 0 is the most significant bit of the first word.
+static inline void set_frame_used(uint16_t frame_num)
+{
+  mem[OS_FREE_BITMAP + frame_num / 16] &= ~(1 << (15 - frame_num % 16));
+}
+
+// This function sets a frame as free in the free bitmap.
+static inline void set_frame_free(uint16_t frame_num)
+{
+  mem[OS_FREE_BITMAP + frame_num / 16] |= (1 << (15 - frame_num % 16));
+}
+
+// This function checks if a frame is free in the free bitmap.
+static inline bool is_frame_free(uint16_t frame_num)
+{
+  return mem[OS_FREE_BITMAP + frame_num / 16] & (1 << (15 - frame_num % 16));
+}
+
+// This function finds the lowest free frame at or above first_frame (a multiple of 16),
+// skipping fully used bitmap words. Returns 0 if none is free.
+static inline uint16_t find_free_frame(uint16_t first_frame)
+{
+  for (uint16_t word = first_frame / 16; word < BITMAP_WORDS; word++)
+  {
+    uint16_t bits = mem[OS_FREE_BITMAP + word];
+    if (bits != 0)
+    {
+      // the highest set bit is the lowest numbered free frame of this word
+      return word * 16 + (__builtin_clz(bits) - 16);
+    }
+  }
+  return 0;
+}
+
+// PCB Operations
+
+// This function gets the base address of a PCB for a given process ID.
+static inline uint16_t get_pcb_base(uint16_t pid)
+{
+  return PCB_BASE + (pid * PCB_SIZE);
+}
+
+// Frame holding the page tables of each group of PT_PER_FRAME pids, 0 if the group has none
+uint16_t page_table_frames[MAX_PROCS / PT_PER_FRAME + 1] = {OS_FRAMES - 1};
+// Number of live processes in each group
+uint16_t page_table_users[MAX_PROCS / PT_PER_FRAME + 1];
+
+// This function gets the base address of a page table for a given process ID.
+static inline uint16_t get_page_table_base(uint16_t pid)
+{
+  return page_table_frames[pid / PT_PER_FRAME] * FRAME_SIZE + (pid % PT_PER_FRAME) * PT_STRIDE;
+}
+
+// This function reserves the page table of a new process, allocating a page table frame for its group if needed.
+// Returns the page table base or 0 if no frame below PT_FRAME_LIMIT is free.
+static inline uint16_t alloc_page_table(uint16_t pid)
+{
+  uint16_t group = pid / PT_PER_FRAME;
+  if (page_table_frames[group] == 0)
+  {
+    uint16_t frame = find_free_frame(0);
+    if (frame == 0 || frame >= PT_FRAME_LIMIT)
+    {
+      return 0;
+    }
+    set_frame_used(frame);
+    memset(&mem[(uint32_t)frame * FRAME_SIZE], 0, FRAME_SIZE * sizeof(uint16_t));
+    page_table_frames[group] = frame;
+  }
+  page_table_users[group]++;
+
+  // a recycled slot still holds the invalidated entries of its previous owner
+  uint16_t page_table_base = get_page_table_base(pid);
+  memset(&mem[page_table_base], 0, 32 * sizeof(uint16_t));
+  return page_table_base;
+}
+
+// This function releases the page table of a halted process and frees the group's frame once it is unused.
+static inline void release_page_table(uint16_t pid)
+{
+  uint16_t group = pid / PT_PER_FRAME;
+  if (--page_table_users[group] == 0 && group != 0)
+  {
+    set_frame_free(page_table_frames[group]);
+    page_table_frames[group] = 0;
+  }
+}
+
+// This function checks if a process is terminated by checking the PID_PCB field in the PCB.
+static inline bool is_process_terminated(uint16_t pid)
+{
+  return mem[get_pcb_base(pid) + PID_PCB] == 0xffff;
+}
+
+// This function finds a PCB slot for a new process. The slot of a halted process is reused
+// before the list grows. Returns 0xffff if all MAX_PROCS slots hold live processes.
+static inline uint16_t find_free_pcb_slot()
+{
+  for (uint16_t pid = 0; pid < mem[Proc_Count]; pid++)
+  {
+    if (is_process_terminated(pid))
+    {
+      return pid;
+    }
+  }
+  return mem[Proc_Count] < MAX_PROCS ? mem[Proc_Count] : 0xffff;
+}
+
+// Address Translation
+
+// This function gets the virtual page number from an address.
+static inline uint16_t get_virtual_page_number(uint16_t address)
+{
+  return address >> 11;
+}
+
+// This function gets the page offset from an address.
+static inline uint16_t get_page_offset(uint16_t address)
+{
+  return address & 0x07FF;
+}
+
+// This function gets the physical address from a frame number and an offset.
+static inline uint32_t get_physical_address(uint16_t frame_num, uint16_t offset)
+{
+  return ((uint32_t)frame_num << 11) | offset;
+}
+
+// Event Trace
+
+#if VM_TRACE
+trace_rec trace_ring[TRACE_RING_SIZE]; // ring buffer of the most recent events
+uint64_t trace_head = 0;              // number of events emitted so far
+uint64_t trace_flushed = 0;           // number of events already written to trace_out
+uint64_t trace_counts[EV_COUNT];      // per event type counters for the summary
+FILE *trace_out = NULL;               // binary trace file, NULL means events are echoed as text
+#endif
+
+// This function writes the records that are not yet in the trace file.
+static inline void trace_flush()
+{
+#if VM_TRACE
+  if (trace_out == NULL)
+  {
+    return;
+  }
+  // Records older than one ring length were overwritten, skip them
+  if (trace_head - trace_flushed > TRACE_RING_SIZE)
+  {
+    trace_flushed = trace_head - TRACE_RING_SIZE;
+  }
+  while (trace_flushed < trace_head)
+  {
+    uint64_t start = trace_flushed & (TRACE_RING_SIZE - 1);
+    uint64_t n = trace_head - trace_flushed;
+    if (n > TRACE_RING_SIZE - start)
+    {
+      n = TRACE_RING_SIZE - start;
+    }
+    fwrite(trace_ring + start, sizeof(trace_rec), n, trace_out);
+    trace_flushed += n;
+  }
+#endif
+}
+
+// This function flushes the ring, rewrites the header with the final counters and closes the trace file.
+static inline void trace_close()
+{
+#if VM_TRACE
+  if (trace_out == NULL)
+  {
+    return;
+  }
+  trace_flush();
+  trace_hdr hdr = {TRACE_MAGIC, TRACE_VERSION, sizeof(trace_rec), icount, trace_head};
+  fseek(trace_out, 0, SEEK_SET);
+  fwrite(&hdr, sizeof(hdr), 1, trace_out);
+  fclose(trace_out);
+  trace_out = NULL;
+#endif
+}
+
+// This function opens the binary trace file named by the VM_TRACE_OUT environment variable.
+// Without it every event is still recorded but also echoed to stdout as before.
+static inline void trace_open()
+{
+#if VM_TRACE
+  const char *path = getenv("VM_TRACE_OUT");
+  if (path == NULL || trace_out != NULL)
+  {
+    return;
+  }
+  trace_out = fopen(path, "wb");
+  if (trace_out == NULL)
+  {
+    fprintf(stderr, "Cannot open trace file %s.\n", path);
+    return;
+  }
+  trace_hdr hdr = {TRACE_MAGIC, TRACE_VERSION, sizeof(trace_rec), 0, 0};
+  fwrite(&hdr, sizeof(hdr), 1, trace_out);
+  atexit(trace_close);
+#endif
+}
+
+// This function records an OS event. It replaces the printf calls that used to sit in the execution path.
+static inline void trace_emit(uint16_t type, uint16_t pid, uint16_t vpn, uint16_t frame)
+{
+#if VM_TRACE
+  trace_rec *rec = &trace_ring[trace_head & (TRACE_RING_SIZE - 1)];
+  rec->icount = icount;
+  rec->type = type;
+  rec->pid = pid;
+  rec->vpn = vpn;
+  rec->frame = frame;
+  trace_head++;
+  trace_counts[type]++;
+
+  if (trace_out == NULL) // no trace file, keep the old text output
+  {
+    trace_fprint(stdout, rec);
+  }
+  else if ((trace_head & (TRACE_RING_SIZE - 1)) == 0) // ring is full
+  {
+    trace_flush();
+  }
+#else
+  trace_rec rec = {icount, type, pid, vpn, frame};
+  trace_fprint(stdout, &rec);
+#endif
+}
+
+// Working-Set Telemetry
+
+// Per-process results of the working-set sampler
+typedef struct wss_stat
+{
+  uint16_t resident;  // valid pages at the last sample
+  uint16_t wss;       // pages referenced during the last sampling window
+  uint16_t peak_wss;  // largest wss seen so far
+  uint16_t dirty;     // dirty pages at the last sample
+  uint32_t samples;   // number of windows sampled
+  uint64_t wss_total; // sum of wss over all samples, for the mean
+} wss_stat;
+
+wss_stat wss_stats[MAX_PROCS];
+FILE *wss_report_out = NULL; // host-side report file named by VM_WSS_REPORT
+
+// This function samples one process: counts resident, referenced and dirty pages and clears the reference bits.
+static inline void wss_sample_proc(uint16_t pid)
+{
+  uint16_t page_table_base = get_page_table_base(pid);
+  uint16_t resident = 0, referenced = 0, dirty = 0;
+
+  for (int vpn = 0; vpn < 32; vpn++)
+  {
+    uint16_t page_table_entry = mem[page_table_base + vpn];
+    if (!is_page_valid(page_table_entry))
+    {
+      continue;
+    }
+    resident++;
+    if (is_page_dirty(page_table_entry))
+    {
+      dirty++;
+    }
+    if (is_page_referenced(page_table_entry))
+    {
+      referenced++;
+      mem[page_table_base + vpn] = page_table_entry & ~PTE_REFERENCED; // start a new window
+    }
+  }
+
+  wss_stat *st = &wss_stats[pid];
+  st->resident = resident;
+  st->wss = referenced;
+  st->dirty = dirty;
+  st->samples++;
+  st->wss_total += referenced;
+  if (referenced > st->peak_wss)
+  {
+    st->peak_wss = referenced;
+  }
+}
+
+// This function is the periodic sampler called from run() every WSS_INTERVAL instructions.
+void wss_sample()
+{
+  for (uint16_t pid = 0; pid < mem[Proc_Count] && pid < MAX_PROCS; pid++)
+  {
+    if (!is_process_terminated(pid))
+    {
+      wss_sample_proc(pid);
+    }
+  }
+  wss_next_sample = icount + WSS_INTERVAL;
+}
+
+// This function prints the per-process working-set report.
+void fprintf_wss_report(FILE *f)
+{
+  fprintf(f, "pid state resident dirty wss peak_wss mean_wss samples\n");
+  for (uint16_t pid = 0; pid < mem[Proc_Count] && pid < MAX_PROCS; pid++)
+  {
+    wss_stat *st = &wss_stats[pid];
+    fprintf(f, "%3d %-6s %8d %5d %3d %8d %8.2f %7u\n", pid,
+            is_process_terminated(pid) ? "halted" : "live", st->resident, st->dirty, st->wss, st->peak_wss,
+            st->samples ? (double)st->wss_total / st->samples : 0.0, st->samples);
+  }
+}
+
+// This function writes the report at exit when VM_WSS_REPORT is set.
+static inline void wss_report_close()
+{
+  if (wss_report_out == NULL)
+  {
+    return;
+  }
+  fprintf_wss_report(wss_report_out);
+  if (wss_report_out != stderr)
+  {
+    fclose(wss_report_out);
+  }
+  wss_report_out = NULL;
+}
+
+// This function opens the report file named by VM_WSS_REPORT ("-" means stderr).
+static inline void wss_report_open()
+{
+  const char *path = getenv("VM_WSS_REPORT");
+  if (path == NULL || wss_report_out != NULL)
+  {
+    return;
+  }
+  wss_report_out = strcmp(path, "-") == 0 ? stderr : fopen(path, "w");
+  if (wss_report_out == NULL)
+  {
+    fprintf(stderr, "Cannot open report file %s.\n", path);
+    return;
+  }
+  atexit(wss_report_close);
+}
+
+// Scheduling
+
+// Pluggable scheduling policy. tyld(), thalt() and the quantum timer only talk to the policy through these hooks.
+typedef struct scheduler
+{
+  const char *name;
+  uint16_t (*pick_next)(uint16_t current_pid); // next pid to run, 0xffff if nothing is runnable
+  void (*on_yield)(uint16_t pid);              // pid gave up the CPU (YIELD) or waited for input
+  void (*on_halt)(uint16_t pid);               // pid halted
+  void (*on_quantum_expiry)(uint16_t pid);     // pid used its whole quantum and is being preempted
+  uint32_t (*quantum)(uint16_t pid);           // instructions pid may run before preemption, 0 for no limit
+} scheduler;
+
+// Per-process scheduler state and latency accounting, all times are instruction counts
+typedef struct sched_proc
+{
+  uint16_t level;          // MLFQ priority level
+  bool preempted;          // regs below were saved by a preemption and must be restored on dispatch
+  uint16_t regs[RCND + 1]; // R0-R7 and RCND, a YIELD keeps the shared-register behaviour instead
+  uint64_t created;        // creation time
+  uint64_t first_run;      // first dispatch, UINT64_MAX before that
+  uint64_t dispatched;     // start of the current run
+  uint64_t cpu;            // instructions executed
+  uint64_t finished;       // halt time
+} sched_proc;
+
+sched_proc sched_procs[MAX_PROCS];
+uint32_t sched_quantum = 0;           // VM_QUANTUM, preemption quantum of round robin (0 = only YIELD switches)
+uint64_t mlfq_next_boost = MLFQ_BOOST_INTERVAL;
+uint64_t sched_completed = 0;         // number of halted processes
+uint64_t sched_total_wait = 0;        // sums over halted processes
+uint64_t sched_total_response = 0;
+uint64_t sched_total_turnaround = 0;
+FILE *sched_report_out = NULL;        // report file named by VM_SCHED_REPORT
+
+// Round robin in PID order, the original policy
+
+// This function picks the next non-terminated process after current_pid, or current_pid itself if it is the only one.
+static uint16_t rr_pick_next(uint16_t current_pid)
+{
+  uint16_t count = mem[Proc_Count];
+  for (uint16_t step = 1; step <= count; step++)
+  {
+    uint16_t pid = (current_pid + step) % count;
+    if (!is_process_terminated(pid))
+    {
+      return pid;
+    }
+  }
+  return 0xffff;
+}
+
+static void rr_nop(uint16_t pid) {}
+static uint32_t rr_quantum(uint16_t pid) { return sched_quantum; }
+
+scheduler sched_rr = {"rr", rr_pick_next, rr_nop, rr_nop, rr_nop, rr_quantum};
+
+// Multi-level feedback queue
+
+// This function picks the next process of the highest non-empty level, round robin inside the level.
+// Every MLFQ_BOOST_INTERVAL instructions all processes go back to level 0 so long jobs cannot starve.
+static uint16_t mlfq_pick_next(uint16_t current_pid)
+{
+  uint16_t count = mem[Proc_Count];
+  if (icount >= mlfq_next_boost)
+  {
+    for (uint16_t pid = 0; pid < count; pid++)
+    {
+      sched_procs[pid].level = 0;
+    }
+    mlfq_next_boost = icount + MLFQ_BOOST_INTERVAL;
+  }
+
+  for (uint16_t level = 0; level < MLFQ_LEVELS; level++)
+  {
+    for (uint16_t step = 1; step <= count; step++)
+    {
+      uint16_t pid = (current_pid + step) % count;
+      if (!is_process_terminated(pid) && sched_procs[pid].level == level)
+      {
+        return pid;
+      }
+    }
+  }
+  return 0xffff;
+}
+
+// This function promotes a process that yields or waits for input.
+static void mlfq_on_yield(uint16_t pid)
+{
+  if (sched_procs[pid].level > 0)
+  {
+    sched_procs[pid].level--;
+  }
+}
+
+// This function demotes a process that used its whole quantum.
+static void mlfq_on_quantum_expiry(uint16_t pid)
+{
+  if (sched_procs[pid].level < MLFQ_LEVELS - 1)
+  {
+    sched_procs[pid].level++;
+  }
+}
+
+static uint32_t mlfq_quantum(uint16_t pid)
+{
+  return (sched_quantum ? sched_quantum : MLFQ_BASE_QUANTUM) << sched_procs[pid].level;
+}
+
+scheduler sched_mlfq = {"mlfq", mlfq_pick_next, mlfq_on_yield, rr_nop, mlfq_on_quantum_expiry, mlfq_quantum};
+
+scheduler *sched = &sched_rr; // active policy, chosen with VM_SCHED=rr|mlfq
+
+// This function resets the scheduler state of a newly created process.
+static inline void sched_on_create(uint16_t pid)
+{
+  memset(&sched_procs[pid], 0, sizeof(sched_proc));
+  sched_procs[pid].created = icount;
+  sched_procs[pid].first_run = UINT64_MAX;
+}
+
+// This function charges the instructions since the last dispatch to pid.
+static inline void sched_stop(uint16_t pid)
+{
+  if (pid < MAX_PROCS)
+  {
+    sched_procs[pid].cpu += icount - sched_procs[pid].dispatched;
+    sched_procs[pid].dispatched = icount;
+  }
+}
+
+// This function starts a run of pid: records the dispatch, restores preempted registers and arms the quantum.
+static inline void sched_start(uint16_t pid)
+{
+  sched_proc *sp = &sched_procs[pid];
+  sp->dispatched = icount;
+  if (sp->first_run == UINT64_MAX)
+  {
+    sp->first_run = icount;
+  }
+  if (sp->preempted)
+  {
+    memcpy(reg, sp->regs, sizeof(sp->regs));
+    sp->preempted = false;
+  }
+
+  uint32_t quantum = sched->quantum(pid);
+  slice_end = quantum ? icount + quantum : UINT64_MAX;
+  next_tick = slice_end < wss_next_sample ? slice_end : wss_next_sample;
+}
+
+// This function records the latency numbers of a halting process.
+static inline void sched_on_halt(uint16_t pid)
+{
+  sched_stop(pid);
+  sched_proc *sp = &sched_procs[pid];
+  sp->finished = icount;
+  uint64_t turnaround = sp->finished - sp->created;
+  sched_completed++;
+  sched_total_turnaround += turnaround;
+  sched_total_wait += turnaround - sp->cpu;
+  sched_total_response += sp->first_run - sp->created;
+  sched->on_halt(pid);
+}
+
+// This function is called by the input traps. The VM's I/O is synchronous, so waiting for input
+// only counts as giving up the CPU for the policy's priority decisions.
+static inline void sched_io_wait()
+{
+  if (mem[Cur_Proc_ID] < MAX_PROCS)
+  {
+    sched->on_yield(mem[Cur_Proc_ID]);
+  }
+}
+
+// This function prints the per-process wait, response and turnaround times.
+void fprintf_sched_report(FILE *f)
+{
+  fprintf(f, "scheduler: %s\n", sched->name);
+  fprintf(f, "pid state  level      cpu     wait response turnaround\n");
+  for (uint16_t pid = 0; pid < mem[Proc_Count] && pid < MAX_PROCS; pid++)
+  {
+    sched_proc *sp = &sched_procs[pid];
+    bool halted = is_process_terminated(pid);
+    uint64_t end = halted ? sp->finished : icount;
+    uint64_t response = sp->first_run == UINT64_MAX ? end - sp->created : sp->first_run - sp->created;
+    fprintf(f, "%3d %-6s %5d %8llu %8llu %8llu %10llu\n", pid, halted ? "halted" : "live", sp->level,
+            (unsigned long long)sp->cpu, (unsigned long long)(end - sp->created - sp->cpu),
+            (unsigned long long)response, (unsigned long long)(end - sp->created));
+  }
+  if (sched_completed)
+  {
+    fprintf(f, "completed: %llu, mean wait: %.1f, mean response: %.1f, mean turnaround: %.1f\n",
+            (unsigned long long)sched_completed, (double)sched_total_wait / sched_completed,
+            (double)sched_total_response / sched_completed, (double)sched_total_turnaround / sched_completed);
+  }
+}
+
+// This function writes the report at exit when VM_SCHED_REPORT is set.
+static inline void sched_report_close()
+{
+  if (sched_report_out == NULL)
+  {
+    return;
+  }
+  fprintf_sched_report(sched_report_out);
+  if (sched_report_out != stderr)
+  {
+    fclose(sched_report_out);
+  }
+  sched_report_out = NULL;
+}
+
+// This function selects the policy and quantum from VM_SCHED and VM_QUANTUM and opens the VM_SCHED_REPORT file.
+static inline void sched_init()
+{
+  const char *policy = getenv("VM_SCHED");
+  sched = (policy != NULL && strcmp(policy, "mlfq") == 0) ? &sched_mlfq : &sched_rr;
+
+  const char *quantum = getenv("VM_QUANTUM");
+  sched_quantum = quantum ? (uint32_t)strtoul(quantum, NULL, 10) : 0;
+
+  const char *path = getenv("VM_SCHED_REPORT");
+  if (path == NULL || sched_report_out != NULL)
+  {
+    return;
+  }
+  sched_report_out = strcmp(path, "-") == 0 ? stderr : fopen(path, "w");
+  if (sched_report_out == NULL)
+  {
+    fprintf(stderr, "Cannot open report file %s.\n", path);
+    return;
+  }
+  atexit(sched_report_close);
+}
+
+// Debugger
+
+// A breakpoint replaces the instruction word in the process' code frame with DBG_STUB | slot, so
+// run() needs no per-instruction check. A watchpoint clears the write bit of the page's entry and
+// is handled in the write-protection fault path of mw().
+typedef struct breakpoint
+{
+  bool used;
+  uint16_t pid;
+  uint16_t address; // virtual address
+  uint32_t phys;    // patched physical word
+  uint16_t orig;    // instruction word the stub replaced
+} breakpoint;
+
+typedef struct watchpoint
+{
+  bool used;
+  uint16_t pid;
+  uint16_t ptbr;
+  uint16_t address;
+  bool writable; // write permission of the page before it was protected
+} watchpoint;
+
+breakpoint dbg_breakpoints[DBG_MAX_BREAKPOINTS];
+watchpoint dbg_watchpoints[DBG_MAX_WATCHPOINTS];
+
+// This function translates address in the address space of pid without faulting. Returns false if it is not mapped.
+static inline bool dbg_translate(uint16_t pid, uint16_t address, uint32_t *phys)
+{
+  if (pid >= mem[Proc_Count] || is_process_terminated(pid))
+  {
+    return false;
+  }
+  uint16_t page_table_entry = mem[mem[get_pcb_base(pid) + PTBR_PCB] + get_virtual_page_number(address)];
+  if (!is_page_valid(page_table_entry))
+  {
+    return false;
+  }
+  *phys = get_physical_address(get_frame_number(page_table_entry), get_page_offset(address));
+  return true;
+}
+
+static void dbg_add_breakpoint(uint16_t pid, uint16_t address)
+{
+  uint32_t phys;
+  if (!dbg_translate(pid, address, &phys))
+  {
+    printf("Address 0x%04x is not mapped in pid %d.\n", address, pid);
+    return;
+  }
+  for (int slot = 0; slot < DBG_MAX_BREAKPOINTS; slot++)
+  {
+    if (dbg_breakpoints[slot].used && dbg_breakpoints[slot].phys == phys)
+    {
+      printf("Breakpoint %d is already at 0x%04x.\n", slot, address);
+      return;
+    }
+  }
+  for (int slot = 0; slot < DBG_MAX_BREAKPOINTS; slot++)
+  {
+    if (!dbg_breakpoints[slot].used)
+    {
+      dbg_breakpoints[slot] = (breakpoint){true, pid, address, phys, mem[phys]};
+      mem[phys] = DBG_STUB | slot;
+      printf("Breakpoint %d at pid %d 0x%04x.\n", slot, pid, address);
+      return;
+    }
+  }
+  printf("Too many breakpoints.\n");
+}
+
+static void dbg_delete_breakpoint(int slot)
+{
+  if (slot < 0 || slot >= DBG_MAX_BREAKPOINTS || !dbg_breakpoints[slot].used)
+  {
+    printf("No breakpoint %d.\n", slot);
+    return;
+  }
+  mem[dbg_breakpoints[slot].phys] = dbg_breakpoints[slot].orig;
+  dbg_breakpoints[slot].used = false;
+}
+
+// This function sets the write bit of a watched page back unless another watchpoint still covers it.
+static void dbg_unprotect(int slot)
+{
+  watchpoint *wp = &dbg_watchpoints[slot];
+  uint16_t vpn = get_virtual_page_number(wp->address);
+  for (int other = 0; other < DBG_MAX_WATCHPOINTS; other++)
+  {
+    if (other != slot && dbg_watchpoints[other].used && dbg_watchpoints[other].ptbr == wp->ptbr &&
+        get_virtual_page_number(dbg_watchpoints[other].address) == vpn)
+    {
+      return;
+    }
+  }
+  if (wp->writable)
+  {
+    mem[wp->ptbr + vpn] |= 0x0004;
+  }
 }
 
-void run(char *code, char *heap)
+static void dbg_add_watchpoint(uint16_t pid, uint16_t address)
 {
-  while (running)
+  uint32_t phys;
+  if (!dbg_translate(pid, address, &phys))
   {
-    uint16_t i = mr(reg[RPC]++);
-    op_ex[OPC(i)](i);
+    printf("Address 0x%04x is not mapped in pid %d.\n", address, pid);
+    return;
   }
-}
-
-// YOUR CODE STARTS HERE
-
-// baris.pome - CS307 - PA4 - 31311
-
-// I realized that i can implement some helper functions to make the code more readable and efficient
-// Helper Functions
+  uint16_t ptbr = mem[get_pcb_base(pid) + PTBR_PCB];
+  uint16_t vpn = get_virtual_page_number(address);
+  bool writable = has_write_permission(mem[ptbr + vpn]);
 
-// page_table_entry Operations
+  // a page that is already protected by another watchpoint keeps its original permission
+  for (int slot = 0; slot < DBG_MAX_WATCHPOINTS; slot++)
+  {
+    watchpoint *wp = &dbg_watchpoints[slot];
+    if (wp->used && wp->ptbr == ptbr && get_virtual_page_number(wp->address) == vpn)
+    {
+      writable = wp->writable;
+    }
+  }
+  for (int slot = 0; slot < DBG_MAX_WATCHPOINTS; slot++)
+  {
+    if (!dbg_watchpoints[slot].used)
+    {
+      dbg_watchpoints[slot] = (watchpoint){true, pid, ptbr, address, writable};
+      mem[ptbr + vpn] &= ~0x0004;
+      printf("Watchpoint %d at pid %d 0x%04x.\n", slot, pid, address);
+      return;
+    }
+  }
+  printf("Too many watchpoints.\n");
+}
 
-// This function creates a page table entry (page_table_entry) with the given frame number, read permission, and write permission.
-static inline uint16_t create_page_table_entry(uint16_t frame_num, bool read, bool write)
+static void dbg_delete_watchpoint(int slot)
 {
-  uint16_t page_table_entry = (frame_num << 11) | 0x0001; // Valid bit
-  if (read)
-    page_table_entry |= 0x0002; // Read bit
-  if (write)
-    page_table_entry |= 0x0004; // Write bit
-  return page_table_entry;
+  if (slot < 0 || slot >= DBG_MAX_WATCHPOINTS || !dbg_watchpoints[slot].used)
+  {
+    printf("No watchpoint %d.\n", slot);
+    return;
+  }
+  dbg_unprotect(slot);
+  dbg_watchpoints[slot].used = false;
 }
 
-// This function checks if a page table entry (page_table_entry) is valid.
-static inline bool is_page_valid(uint16_t page_table_entry)
+// This function drops the breakpoints and watchpoints of a halting process.
+static inline void dbg_forget(uint16_t pid)
 {
-  return page_table_entry & 0x0001;
+  for (int slot = 0; slot < DBG_MAX_BREAKPOINTS; slot++)
+  {
+    if (dbg_breakpoints[slot].used && dbg_breakpoints[slot].pid == pid)
+    {
+      dbg_delete_breakpoint(slot);
+    }
+  }
+  for (int slot = 0; slot < DBG_MAX_WATCHPOINTS; slot++)
+  {
+    if (dbg_watchpoints[slot].used && dbg_watchpoints[slot].pid == pid)
+    {
+      dbg_delete_watchpoint(slot);
+    }
+  }
 }
 
-// This function checks if a page table entry (page_table_entry) has read permission.
-static inline bool has_read_permission(uint16_t page_table_entry)
+static void dbg_info()
 {
-  return page_table_entry & 0x0002;
+  for (int slot = 0; slot < DBG_MAX_BREAKPOINTS; slot++)
+  {
+    breakpoint *bp = &dbg_breakpoints[slot];
+    if (bp->used)
+      printf("breakpoint %d: pid %d 0x%04x (instr 0x%04x)\n", slot, bp->pid, bp->address, bp->orig);
+  }
+  for (int slot = 0; slot < DBG_MAX_WATCHPOINTS; slot++)
+  {
+    watchpoint *wp = &dbg_watchpoints[slot];
+    if (wp->used)
+      printf("watchpoint %d: pid %d 0x%04x\n", slot, wp->pid, wp->address);
+  }
 }
 
-// This function checks if a page table entry (page_table_entry) has write permission.
-static inline bool has_write_permission(uint16_t page_table_entry)
+static void dbg_examine(uint16_t pid, uint16_t address, int count)
 {
-  return page_table_entry & 0x0004;
+  for (int n = 0; n < count; n++, address++)
+  {
+    uint32_t phys;
+    if (!dbg_translate(pid, address, &phys))
+    {
+      printf("0x%04x: not mapped\n", address);
+      return;
+    }
+    uint16_t word = mem[phys];
+    for (int slot = 0; slot < DBG_MAX_BREAKPOINTS; slot++) // show the code, not the stubs
+    {
+      if (dbg_breakpoints[slot].used && dbg_breakpoints[slot].phys == phys)
+        word = dbg_breakpoints[slot].orig;
+    }
+    printf("0x%04x: 0x%04x (dec: %d)\n", address, word, word);
+  }
 }
 
-// This function extracts the frame number from a page table entry (page_table_entry).
-static inline uint16_t get_frame_number(uint16_t page_table_entry)
+// This function is the command loop. It returns when the guest should continue.
+// Commands: b <addr> [pid], d <n>, w <addr> [pid], dw <n>, i, r, x <addr> [count] [pid], c, q, h.
+// Addresses are hexadecimal virtual addresses, pid defaults to the running process.
+void dbg_prompt()
 {
-  return page_table_entry >> 11;
+  char line[256];
+  while (printf("(vmdb) "), fflush(stdout), fgets(line, sizeof(line), stdin) != NULL)
+  {
+    char cmd[8] = "";
+    unsigned int arg1 = 0, arg2 = 0, arg3 = 0;
+    int nargs = sscanf(line, "%7s %x %u %u", cmd, &arg1, &arg2, &arg3);
+    uint16_t current_pid = mem[Cur_Proc_ID] == 0xffff ? 0 : mem[Cur_Proc_ID];
+
+    if (nargs <= 0)
+      continue;
+    else if (strcmp(cmd, "c") == 0)
+      return;
+    else if (strcmp(cmd, "q") == 0)
+      exit(0);
+    else if (strcmp(cmd, "b") == 0 && nargs >= 2)
+      dbg_add_breakpoint(nargs >= 3 ? arg2 : current_pid, arg1);
+    else if (strcmp(cmd, "w") == 0 && nargs >= 2)
+      dbg_add_watchpoint(nargs >= 3 ? arg2 : current_pid, arg1);
+    else if (strcmp(cmd, "d") == 0 && sscanf(line, "%*s %u", &arg1) == 1)
+      dbg_delete_breakpoint(arg1);
+    else if (strcmp(cmd, "dw") == 0 && sscanf(line, "%*s %u", &arg1) == 1)
+      dbg_delete_watchpoint(arg1);
+    else if (strcmp(cmd, "i") == 0)
+      dbg_info();
+    else if (strcmp(cmd, "r") == 0)
+      fprintf_reg_all(stdout, reg, RCNT);
+    else if (strcmp(cmd, "x") == 0 && nargs >= 2)
+      dbg_examine(nargs >= 4 ? arg3 : current_pid, arg1, nargs >= 3 ? arg2 : 1);
+    else
+      printf("Commands: b <addr> [pid], d <n>, w <addr> [pid], dw <n>, i, r, x <addr> [count] [pid], c, q\n");
+  }
+  dbg_enabled = false; // stdin closed, run to the end
 }
 
-// Bitmap Operations
-
-// This function sets a frame as used in the free bitmap.
-static inline void set_frame_used(uint16_t frame_num)
+// This function handles a breakpoint stub: stops in the command loop, then executes the original instruction.
+static inline void dbg_break(uint16_t i)
 {
-  if (frame_num < 16)
+  breakpoint *bp = &dbg_breakpoints[i & (DBG_MAX_BREAKPOINTS - 1)];
+  if ((i & 0x0FFF) >= DBG_MAX_BREAKPOINTS || !bp->used)
   {
-    mem[OS_FREE_BITMAP] &= ~(1 << (15 - frame_num));
+    return; // a genuine opcode 13, which stays unused
   }
-  else
+  uint16_t orig = bp->orig;
+  printf("Breakpoint %d, pid %d at 0x%04x.\n", (int)(i & 0x0FFF), mem[Cur_Proc_ID], (uint16_t)(reg[RPC] - 1));
+  if (dbg_enabled)
   {
-    mem[OS_FREE_BITMAP + 1] &= ~(1 << (31 - frame_num));
+    dbg_prompt();
   }
+  op_ex[OPC(orig)](orig);
 }
 
-// This function sets a frame as free in the free bitmap.
-static inline void set_frame_free(uint16_t frame_num)
+// This function is called by mw() on a write-protection fault. Writes to pages protected by a
+// watchpoint are performed here and reported; returns false for genuine faults.
+static inline bool dbg_watch_fault(uint16_t address, uint16_t val)
 {
-  if (frame_num < 16)
+  uint16_t vpn = get_virtual_page_number(address);
+  watchpoint *page = NULL;
+  for (int slot = 0; slot < DBG_MAX_WATCHPOINTS; slot++)
+  {
+    watchpoint *wp = &dbg_watchpoints[slot];
+    if (wp->used && wp->ptbr == reg[PTBR] && get_virtual_page_number(wp->address) == vpn)
+    {
+      page = wp;
+      break;
+    }
+  }
+  if (page == NULL || !page->writable)
   {
-    mem[OS_FREE_BITMAP] |= (1 << (15 - frame_num));
+    return false;
   }
-  else
+
+  uint16_t page_table_entry = mem[reg[PTBR] + vpn];
+  uint32_t phys = get_physical_address(get_frame_number(page_table_entry), get_page_offset(address));
+  uint16_t old = mem[phys];
+  mem[phys] = val;
+  mem[reg[PTBR] + vpn] = page_table_entry | PTE_REFERENCED | PTE_DIRTY;
+
+  for (int slot = 0; slot < DBG_MAX_WATCHPOINTS; slot++)
   {
-    mem[OS_FREE_BITMAP + 1] |= (1 << (31 - frame_num));
+    watchpoint *wp = &dbg_watchpoints[slot];
+    if (wp->used && wp->ptbr == reg[PTBR] && wp->address == address)
+    {
+      printf("Watchpoint %d, pid %d: mem[0x%04x] %u -> %u at 0x%04x.\n", slot, wp->pid, address, old, val,
+             (uint16_t)(reg[RPC] - 1));
+      dbg_prompt();
+      break;
+    }
   }
+  return true;
 }
 
-// This function checks if a frame is free in the free bitmap.
-static inline bool is_frame_free(uint16_t frame_num)
-{
-  uint16_t bitmap_region;
-  uint16_t bit_position;
+// Performance Model
 
-  if (frame_num < 16)
+// Simulated cycle costs. Every instruction costs its opcode's cycles; memory accesses go through a
+// fully associative LRU TLB and pay a page-table walk on a miss; traps and context switches add a
+// fixed cost. Loaded from the file named by VM_COST ("default" keeps the built-in numbers).
+typedef struct cost_model
+{
+  uint32_t op[NOPS];    // cycles per opcode
+  uint32_t trap;        // extra cycles of a TRAP on top of its opcode cost
+  uint32_t context_switch;
+  uint32_t tlb_hit;     // cycles of a translation that hits
+  uint32_t walk;        // cycles of a page-table walk after a miss
+  uint32_t tlb_entries; // 0 disables the TLB, every access walks
+  bool tlb_flush;       // flush the TLB on context switches (no address space tags)
+} cost_model;
+
+const char *cost_op_names[NOPS] = {"br", "add", "ld", "st", "jsr", "and", "ldr", "str",
+                                   "rti", "not", "ldi", "sti", "jmp", "res", "lea", "trap"};
+
+cost_model cost = {{1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}, 10, 100, 0, 20, 16, true};
+
+uint64_t cost_cycles = 0;                   // simulated cycles so far
+uint64_t cost_tlb_hits = 0, cost_tlb_misses = 0;
+uint64_t cost_switches = 0, cost_traps = 0;
+uint16_t tlb_vpn[TLB_MAX_ENTRIES];          // cached virtual page numbers
+uint64_t tlb_used[TLB_MAX_ENTRIES];         // last use, 0 marks an empty entry
+uint64_t tlb_clock = 0;
+uint64_t cost_proc_cycles[MAX_PROCS];       // cycles per process
+uint64_t cost_proc_instrs[MAX_PROCS];       // instructions per process
+uint64_t *cost_pc_cycles[MAX_PROCS];        // cycles per PC in the code segment, allocated on first use
+FILE *cost_report_out = NULL;
+
+// This function models the translation of vpn through the TLB.
+static inline void cost_access(uint16_t vpn)
+{
+  tlb_clock++;
+  int victim = 0;
+  for (uint32_t e = 0; e < cost.tlb_entries; e++)
   {
-    bitmap_region = mem[OS_FREE_BITMAP];
-    bit_position = 15 - frame_num;
+    if (tlb_used[e] && tlb_vpn[e] == vpn)
+    {
+      tlb_used[e] = tlb_clock;
+      cost_tlb_hits++;
+      cost_cycles += cost.tlb_hit;
+      return;
+    }
+    if (tlb_used[e] < tlb_used[victim])
+    {
+      victim = e;
+    }
   }
-  else
+  cost_tlb_misses++;
+  cost_cycles += cost.walk;
+  if (cost.tlb_entries)
   {
-    bitmap_region = mem[OS_FREE_BITMAP + 1];
-    bit_position = 31 - frame_num;
+    tlb_vpn[victim] = vpn;
+    tlb_used[victim] = tlb_clock;
   }
-
-  return bitmap_region & (1 << bit_position);
 }
 
-// PCB Operations
-
-// This function gets the base address of a PCB for a given process ID.
-static inline uint16_t get_pcb_base(uint16_t pid)
+// This function charges a context switch and flushes the TLB.
+static inline void cost_switch()
 {
-  return 12 + (pid * PCB_SIZE);
+  cost_switches++;
+  cost_cycles += cost.context_switch;
+  if (cost.tlb_flush)
+  {
+    memset(tlb_used, 0, sizeof(tlb_used));
+  }
 }
 
-// This function gets the base address of a page table for a given process ID.
-static inline uint16_t get_page_table_base(uint16_t pid)
+static inline void cost_on_create(uint16_t pid)
 {
-  return 4096 + (pid * 64);
+  cost_proc_cycles[pid] = 0;
+  cost_proc_instrs[pid] = 0;
+  if (cost_pc_cycles[pid] != NULL)
+  {
+    memset(cost_pc_cycles[pid], 0, COST_PC_WINDOW * sizeof(uint64_t));
+  }
 }
 
-// This function checks if a process is terminated by checking the PID_PCB field in the PCB.
-static inline bool is_process_terminated(uint16_t pid)
+// This function is the run loop of the performance model: the plain loop plus per-process and per-PC accounting.
+void run_costed()
 {
-  return mem[get_pcb_base(pid) + PID_PCB] == 0xffff;
+  while (running)
+  {
+    uint16_t pid = mem[Cur_Proc_ID];
+    uint16_t pc = reg[RPC];
+    uint64_t start = cost_cycles;
+
+    uint16_t i = mr(reg[RPC]++);
+    cost_cycles += cost.op[OPC(i)];
+    if (OPC(i) == 15)
+    {
+      cost_traps++;
+      cost_cycles += cost.trap;
+    }
+    op_ex[OPC(i)](i);
+    if (++icount >= next_tick)
+    {
+      vm_tick();
+    }
+
+    uint64_t spent = cost_cycles - start;
+    cost_proc_cycles[pid] += spent;
+    cost_proc_instrs[pid]++;
+    if ((uint16_t)(pc - PC_START) < COST_PC_WINDOW)
+    {
+      if (cost_pc_cycles[pid] == NULL)
+      {
+        cost_pc_cycles[pid] = calloc(COST_PC_WINDOW, sizeof(uint64_t));
+      }
+      if (cost_pc_cycles[pid] != NULL)
+      {
+        cost_pc_cycles[pid][pc - PC_START] += spent;
+      }
+    }
+  }
 }
 
-// Address Translation
+// This function prints the simulated cycles per process and the hottest PCs of each.
+void fprintf_cost_report(FILE *f)
+{
+  fprintf(f, "cycles: %llu, instructions: %llu, CPI: %.2f\n", (unsigned long long)cost_cycles,
+          (unsigned long long)icount, icount ? (double)cost_cycles / icount : 0.0);
+  fprintf(f, "tlb hits: %llu, misses: %llu, context switches: %llu, traps: %llu\n",
+          (unsigned long long)cost_tlb_hits, (unsigned long long)cost_tlb_misses,
+          (unsigned long long)cost_switches, (unsigned long long)cost_traps);
+  for (uint16_t pid = 0; pid < mem[Proc_Count] && pid < MAX_PROCS; pid++)
+  {
+    fprintf(f, "pid %d: %llu cycles, %llu instructions\n", pid, (unsigned long long)cost_proc_cycles[pid],
+            (unsigned long long)cost_proc_instrs[pid]);
+    uint64_t *pcs = cost_pc_cycles[pid];
+    if (pcs == NULL)
+    {
+      continue;
+    }
+    // selection of the COST_TOP_PCS largest entries, the table is small
+    uint64_t shown = UINT64_MAX;
+    uint32_t shown_pc = 0;
+    for (int n = 0; n < COST_TOP_PCS; n++)
+    {
+      int best = -1;
+      for (uint32_t k = 0; k < COST_PC_WINDOW; k++)
+      {
+        bool below = pcs[k] < shown || (pcs[k] == shown && k > shown_pc);
+        if (pcs[k] && below && (best < 0 || pcs[k] > pcs[best]))
+        {
+          best = k;
+        }
+      }
+      if (best < 0)
+      {
+        break;
+      }
+      fprintf(f, "  0x%04x: %llu cycles\n", PC_START + best, (unsigned long long)pcs[best]);
+      shown = pcs[best];
+      shown_pc = best;
+    }
+  }
+}
 
-// This function gets the virtual page number from an address.
-static inline uint16_t get_virtual_page_number(uint16_t address)
+static inline void cost_report_close()
 {
-  return address >> 11;
+  if (cost_report_out == NULL)
+  {
+    return;
+  }
+  fprintf_cost_report(cost_report_out);
+  if (cost_report_out != stderr)
+  {
+    fclose(cost_report_out);
+  }
+  cost_report_out = NULL;
 }
 
-// This function gets the page offset from an address.
-static inline uint16_t get_page_offset(uint16_t address)
+// This function reads "<key> <cycles>" lines: an opcode name, trap, switch, tlb_hit, walk,
+// tlb_entries or tlb_flush. Lines starting with '#' are comments.
+static inline void cost_load(const char *path)
 {
-  return address & 0x07FF;
+  FILE *in = fopen(path, "r");
+  if (NULL == in)
+  {
+    fprintf(stderr, "Cannot open file %s.\n", path);
+    exit(1);
+  }
+  char line[256], key[32];
+  unsigned int value;
+  while (fgets(line, sizeof(line), in))
+  {
+    if (line[0] == '#' || sscanf(line, "%31s %u", key, &value) != 2)
+    {
+      continue;
+    }
+    bool known = true;
+    if (strcmp(key, "trap_cost") == 0)
+      cost.trap = value;
+    else if (strcmp(key, "switch") == 0)
+      cost.context_switch = value;
+    else if (strcmp(key, "tlb_hit") == 0)
+      cost.tlb_hit = value;
+    else if (strcmp(key, "walk") == 0)
+      cost.walk = value;
+    else if (strcmp(key, "tlb_entries") == 0)
+      cost.tlb_entries = value > TLB_MAX_ENTRIES ? TLB_MAX_ENTRIES : value;
+    else if (strcmp(key, "tlb_flush") == 0)
+      cost.tlb_flush = value != 0;
+    else
+    {
+      known = false;
+      for (int op = 0; op < NOPS; op++)
+      {
+        if (strcmp(key, cost_op_names[op]) == 0)
+        {
+          cost.op[op] = value;
+          known = true;
+        }
+      }
+    }
+    if (!known)
+    {
+      fprintf(stderr, "Unknown cost model key %s.\n", key);
+    }
+  }
+  fclose(in);
 }
 
-// This function gets the physical address from a frame number and an offset.
-static inline uint16_t get_physical_address(uint16_t frame_num, uint16_t offset)
+// This function enables the model when VM_COST is set. The report goes to VM_COST_REPORT, stderr by default.
+static inline void cost_init()
 {
-  return (frame_num << 11) | offset;
+  const char *path = getenv("VM_COST");
+  if (path == NULL)
+  {
+    return;
+  }
+  if (strcmp(path, "default") != 0)
+  {
+    cost_load(path);
+  }
+  cost_enabled = true;
+
+  const char *report = getenv("VM_COST_REPORT");
+  cost_report_out = (report == NULL || strcmp(report, "-") == 0) ? stderr : fopen(report, "w");
+  if (cost_report_out == NULL)
+  {
+    fprintf(stderr, "Cannot open report file %s.\n", report);
+    return;
+  }
+  atexit(cost_report_close);
 }
 
 // End of Helper Functions
@@ -347,29 +1488,66 @@ static inline uint16_t get_physical_address(uint16_t frame_num, uint16_t offset)
 void initOS()
 {
   // bitmaps
-  mem[OS_FREE_BITMAP + 1] = 0xFFFF;
-  mem[OS_FREE_BITMAP] = 0x1FFF;
+  for (int word = 1; word < BITMAP_WORDS; word++)
+  {
+    mem[OS_FREE_BITMAP + word] = 0xFFFF;
+  }
+  mem[OS_FREE_BITMAP] = 0xFFFF >> OS_FRAMES; // frames 0-2 belong to the OS
+
+  // page table frames, only the group of frame 2 exists initially
+  memset(page_table_frames, 0, sizeof(page_table_frames));
+  memset(page_table_users, 0, sizeof(page_table_users));
+  page_table_frames[0] = OS_FRAMES - 1;
 
   // status registers
   mem[OS_STATUS] = 0x0000;
   mem[Cur_Proc_ID] = 0xffff;
   mem[Proc_Count] = 0;
+
+  trace_open();
+  wss_report_open();
+  sched_init();
+  dbg_enabled = getenv("VM_DEBUG") != NULL;
+  cost_init();
 }
 
 // Process Creation
 
+// This function gives back the slot of a process whose creation failed half way.
+static inline void abort_proc_slot(uint16_t pid)
+{
+  release_page_table(pid);
+  if (pid < mem[Proc_Count]) // a reused slot must look halted again
+  {
+    mem[get_pcb_base(pid) + PID_PCB] = 0xffff;
+  }
+}
+
 // This function creates a new process by allocating memory for its code and heap segments.
 int createProc(char *fname, char *hname)
 {
   // Verify if the OS memory region is full
   if (mem[OS_STATUS] & 0x0001)
   {
-    printf("The OS memory region is full. Cannot create a new PCB.\n");
+    trace_emit(EV_PCB_FULL, mem[Proc_Count], 0, 0);
+    return 0;
+  }
+
+  // Reuse the PCB slot of a halted process if there is one
+  uint16_t process_id = find_free_pcb_slot();
+  if (process_id == 0xffff)
+  {
+    mem[OS_STATUS] |= 0x0001;
+    trace_emit(EV_PCB_FULL, mem[Proc_Count], 0, 0);
     return 0;
   }
 
-  uint16_t process_id = mem[Proc_Count];
-  uint16_t page_table_base = get_page_table_base(process_id);
+  uint16_t page_table_base = alloc_page_table(process_id);
+  if (page_table_base == 0)
+  {
+    trace_emit(EV_PT_NOMEM, process_id, 0, 0);
+    return 0;
+  }
   uint16_t pcb_base = get_pcb_base(process_id);
 
   // Initialize the Process Control Block (PCB)
@@ -382,18 +1560,19 @@ int createProc(char *fname, char *hname)
   mem[pcb_base + PTBR_PCB] = page_table_base;
 
   // Allocate memory for the code segment
-  uint16_t code_frame_addresses[CODE_SIZE];
+  uint32_t code_frame_addresses[CODE_SIZE];
   for (int idx = 0; idx < CODE_SIZE; idx++)
   {
     uint16_t virtual_page_number = idx + 6;
     if (allocMem(page_table_base, virtual_page_number, 0xFFFF, 0) == 0)
     {
-      printf("Cannot create code segment.\n");
+      trace_emit(EV_CODE_NOMEM, process_id, virtual_page_number, 0);
       // rollback code segment
       for (int rollback = 0; rollback < idx; rollback++)
       {
         freeMem(rollback + 6, page_table_base);
       }
+      abort_proc_slot(process_id);
       return 0;
     }
     uint16_t page_table_entry = mem[page_table_base + virtual_page_number];
@@ -405,13 +1584,13 @@ int createProc(char *fname, char *hname)
   ld_img(fname, code_frame_addresses, CODE_SIZE * PAGE_SIZE);
 
   // Allocate memory for the heap segment
-  uint16_t heap_frame_addresses[HEAP_INIT_SIZE];
+  uint32_t heap_frame_addresses[HEAP_INIT_SIZE];
   for (int idx = 0; idx < HEAP_INIT_SIZE; idx++)
   {
     uint16_t heap_virtual_page = idx + 8;                              // get virtual page number
     if (!allocMem(page_table_base, heap_virtual_page, 0xFFFF, 0xFFFF)) // if allocation fails
     {
-      printf("Failed to allocate memory for the heap segment.\n");
+      trace_emit(EV_HEAP_NOMEM, process_id, heap_virtual_page, 0);
       for (int rollback_code = 0; rollback_code < CODE_SIZE; rollback_code++) // rollback code segment
       {
         freeMem(rollback_code + 6, page_table_base);
@@ -420,6 +1599,7 @@ int createProc(char *fname, char *hname)
       {
         freeMem(rollback_heap + 8, page_table_base);
       }
+      abort_proc_slot(process_id);
       return 0;
     }
     // if allocation succeeds
@@ -433,15 +1613,28 @@ int createProc(char *fname, char *hname)
   // Load the heap segment from the file
   ld_img(hname, heap_frame_addresses, HEAP_INIT_SIZE * PAGE_SIZE);
 
-  // Increment the process count
-  mem[Proc_Count]++;
+  // Reset the telemetry and scheduler state of the new process
+  memset(&wss_stats[process_id], 0, sizeof(wss_stat));
+  sched_on_create(process_id);
+  cost_on_create(process_id);
+
+  // Grow the process list unless a halted slot was reused
+  if (process_id == mem[Proc_Count])
+  {
+    mem[Proc_Count]++;
+  }
   return 1;
 }
 
 // This function loads a process into the CPU registers and sets up the current process ID.
 void loadProc(uint16_t pid)
 {
-  // Set the current process ID
+  // Charge the outgoing process and set the current process ID
+  sched_stop(mem[Cur_Proc_ID]);
+  if (cost_enabled && mem[Cur_Proc_ID] != pid)
+  {
+    cost_switch();
+  }
   mem[Cur_Proc_ID] = pid;
 
   // Get the PCB base address for the current process
@@ -452,6 +1645,9 @@ void loadProc(uint16_t pid)
 
   // get page table base register
   reg[PTBR] = mem[pcb_base + PTBR_PCB];
+
+  // restore preempted registers and arm the quantum
+  sched_start(pid);
 }
 
 // Memory Allocation
@@ -465,22 +1661,18 @@ uint16_t allocMem(uint16_t ptbr, uint16_t vpn, uint16_t read, uint16_t write)
     return 0;
   }
 
-  // Find free frame
-  uint16_t current_pfn = 3;
-  while (current_pfn < 32)
+  // Find free frame, the OS frames are never marked free so 0 means none is left.
+  // Frames above PT_FRAME_LIMIT are used first so the low ones stay available for page tables.
+  uint16_t current_pfn = find_free_frame(PT_FRAME_LIMIT);
+  if (current_pfn == 0)
   {
-    if (is_frame_free(current_pfn))
-    {
-      set_frame_used(current_pfn);
-      break;
-    }
-    current_pfn++;
+    current_pfn = find_free_frame(0);
   }
-
-  if (current_pfn >= 32)
+  if (current_pfn == 0)
   {
     return 0;
   }
+  set_frame_used(current_pfn);
 
   // Create and store page_table_entry
   mem[ptbr + vpn] = create_page_table_entry(current_pfn, read == 0xFFFF, write == 0xFFFF);
@@ -501,7 +1693,7 @@ int freeMem(uint16_t vpn, uint16_t ptbr)
   set_frame_free(frame_number);                               // set frame as free
 
   // Invalidate the page_table_entry
-  mem[ptbr + vpn] &= ~0x0001; // invalidate page_table_entry
+  mem[ptbr + vpn] &= ~(0x0001 | PTE_REFERENCED | PTE_DIRTY); // invalidate page_table_entry
   return 1;
 }
 
@@ -539,33 +1731,46 @@ static inline void tbrk()
   if (allocation_flag) // if allocation flag is true
   {
     // Handle heap allocation
-    printf("Heap increase requested by process %d.\n", current_pid);
+    trace_emit(EV_HEAP_INC, current_pid, virtual_page_number, 0);
     if (is_page_valid(page_table_entry)) // if page_table_entry is valid
     {
-      printf("Cannot allocate memory for page %d of pid %d since it is already allocated.\n",
-             virtual_page_number, current_pid);
+      trace_emit(EV_HEAP_INC_DUP, current_pid, virtual_page_number, get_frame_number(page_table_entry));
       return;
     }
     if (!allocMem(reg[PTBR], virtual_page_number, read_permission, write_permission)) // if allocation fails
     {
-      printf("Cannot allocate more space for pid %d since there is no free page frames.\n",
-             current_pid);
+      trace_emit(EV_HEAP_INC_NOMEM, current_pid, virtual_page_number, 0);
     }
   }
   else
   {
     // Handle heap deallocation
-    printf("Heap decrease requested by process %d.\n", current_pid);
+    trace_emit(EV_HEAP_DEC, current_pid, virtual_page_number, get_frame_number(page_table_entry));
     if (!is_page_valid(page_table_entry)) // if page_table_entry is not valid
     {
-      printf("Cannot free memory of page %d of pid %d since it is not allocated.\n",
-             virtual_page_number, current_pid);
+      trace_emit(EV_HEAP_DEC_UNALLOC, current_pid, virtual_page_number, 0);
       return;
     }
     freeMem(virtual_page_number, reg[PTBR]); // free memory
   }
 }
 
+// This function is the working-set query trap (0x2A).
+// R0 holds the pid to query, 0xFFFF for the caller. Returns the working-set size
+// of the last sampling window in R0 and the resident page count in R1.
+static inline void twss()
+{
+  uint16_t pid = reg[R0] == 0xFFFF ? mem[Cur_Proc_ID] : reg[R0];
+  if (pid >= mem[Proc_Count] || pid >= MAX_PROCS)
+  {
+    reg[R0] = 0xFFFF;
+    reg[R1] = 0xFFFF;
+    return;
+  }
+  reg[R0] = wss_stats[pid].wss;
+  reg[R1] = wss_stats[pid].resident;
+}
+
 // Process Switching
 
 // This function saves the current process state and loads the next process.
@@ -578,21 +1783,14 @@ static inline void tyld()
   mem[pcb_base + PC_PCB] = reg[RPC];
   mem[pcb_base + PTBR_PCB] = reg[PTBR];
 
-  // Find next non-terminated process
-  uint16_t next_pid = (current_pid + 1) % mem[Proc_Count]; // get next pid
-  while (next_pid != current_pid)                          // while next pid is not current pid
-  {
-    if (!is_process_terminated(next_pid)) // if next pid is not terminated
-    {
-      break;
-    }
-    next_pid = (next_pid + 1) % mem[Proc_Count]; // increment next pid
-  }
+  // Let the scheduler pick the next process, the current one is still runnable
+  sched->on_yield(current_pid);
+  uint16_t next_pid = sched->pick_next(current_pid);
 
   // Log process switching if applicable
   if (current_pid != next_pid)
   {
-    printf("We are switching from process %d to %d.\n", current_pid, next_pid); // log process switching
+    trace_emit(EV_SWITCH, current_pid, 0, next_pid); // log process switching, the frame field carries the next pid
   }
 
   // Load the next process
@@ -608,6 +1806,12 @@ static inline void thalt()
   uint16_t pcb_base = get_pcb_base(current_pid);               // get pcb base
   uint16_t page_table_base = get_page_table_base(current_pid); // get page table base
 
+  // Close the last working-set window before the pages go away
+  if (current_pid < MAX_PROCS)
+  {
+    wss_sample_proc(current_pid);
+  }
+
   // Free all allocated pages
   for (int vpn = 6; vpn < 32; vpn++)
   {
@@ -617,19 +1821,24 @@ static inline void thalt()
     }
   }
 
-  // Mark process as terminated
+  if (dbg_enabled)
+  {
+    dbg_forget(current_pid);
+  }
+
+  // Mark process as terminated, its PCB and page table slots can now be reused
   mem[pcb_base + PID_PCB] = 0xffff;
+  release_page_table(current_pid);
+  mem[OS_STATUS] &= ~0x0001;
+
+  sched_on_halt(current_pid);
 
   // Find next runnable process
-  uint16_t next_pid = (current_pid + 1) % mem[Proc_Count]; // get next pid
-  while (next_pid != current_pid)                          // while next pid is not current pid
+  uint16_t next_pid = sched->pick_next(current_pid);
+  if (next_pid != 0xffff)
   {
-    if (!is_process_terminated(next_pid)) // if next pid is not terminated
-    {
-      loadProc(next_pid); // load process
-      return;
-    }
-    next_pid = (next_pid + 1) % mem[Proc_Count]; // increment next pid
+    loadProc(next_pid); // load process
+    return;
   }
 
   running = false; // set running to false
@@ -645,24 +1854,34 @@ static inline uint16_t mr(uint16_t address)
 
   if (vpn < 6)
   {
-    printf("Segmentation fault.\n");
+    trace_emit(EV_SEGFAULT, mem[Cur_Proc_ID], vpn, 0);
     exit(1);
   }
 
+  if (cost_enabled)
+  {
+    cost_access(vpn);
+  }
+
   uint16_t page_table_entry = mem[reg[PTBR] + vpn];
 
   if (!is_page_valid(page_table_entry)) // if page_table_entry is not valid
   {
-    printf("Segmentation fault inside free space.\n");
+    trace_emit(EV_SEGFAULT_FREE, mem[Cur_Proc_ID], vpn, 0);
     exit(1);
   }
 
   if (!has_read_permission(page_table_entry)) // if page_table_entry does not have read permission
   {
-    printf("Cannot read from a write-only page.\n");
+    trace_emit(EV_READ_WO, mem[Cur_Proc_ID], vpn, get_frame_number(page_table_entry));
     exit(1);
   }
 
+  if (!is_page_referenced(page_table_entry)) // only touch the entry on the first access of a window
+  {
+    mem[reg[PTBR] + vpn] = page_table_entry | PTE_REFERENCED;
+  }
+
   uint16_t frame_number = get_frame_number(page_table_entry); // get frame number
   return mem[get_physical_address(frame_number, offset)];     // return value at physical address
 }
@@ -678,26 +1897,78 @@ static inline void mw(uint16_t address, uint16_t val)
   // check if address is in the code segment
   if (vpn < 6)
   {
-    printf("Segmentation fault.\n");
+    trace_emit(EV_SEGFAULT, mem[Cur_Proc_ID], vpn, 0);
     exit(1);
   }
 
+  if (cost_enabled)
+  {
+    cost_access(vpn);
+  }
+
   uint16_t page_table_entry = mem[reg[PTBR] + vpn];
 
   if (!is_page_valid(page_table_entry)) // if page_table_entry is not valid
   {
-    printf("Segmentation fault inside free space.\n");
+    trace_emit(EV_SEGFAULT_FREE, mem[Cur_Proc_ID], vpn, 0);
     exit(1);
   }
 
   if (!has_write_permission(page_table_entry)) // if page_table_entry does not have write permission
   {
-    printf("Cannot write to a read-only page.\n");
+    if (dbg_enabled && dbg_watch_fault(address, val)) // write-protected by a watchpoint
+    {
+      return;
+    }
+    trace_emit(EV_WRITE_RO, mem[Cur_Proc_ID], vpn, get_frame_number(page_table_entry));
     exit(1);
   }
 
+  if ((page_table_entry & (PTE_REFERENCED | PTE_DIRTY)) != (PTE_REFERENCED | PTE_DIRTY))
+  {
+    mem[reg[PTBR] + vpn] = page_table_entry | PTE_REFERENCED | PTE_DIRTY;
+  }
+
   uint16_t frame_number = get_frame_number(page_table_entry); // get frame number
   mem[get_physical_address(frame_number, offset)] = val;      // write value to physical address
 }
 
+// Timer
+
+// This function preempts the running process when its quantum expires. Unlike YIELD, the general
+// registers are saved so the process resumes exactly where it was interrupted.
+static inline void preempt()
+{
+  uint16_t current_pid = mem[Cur_Proc_ID];       // get current pid
+  uint16_t pcb_base = get_pcb_base(current_pid); // get pcb base
+
+  // Save current process state
+  mem[pcb_base + PC_PCB] = reg[RPC];
+  mem[pcb_base + PTBR_PCB] = reg[PTBR];
+  memcpy(sched_procs[current_pid].regs, reg, sizeof(sched_procs[current_pid].regs));
+  sched_procs[current_pid].preempted = true;
+
+  sched->on_quantum_expiry(current_pid);
+  uint16_t next_pid = sched->pick_next(current_pid);
+  if (current_pid != next_pid)
+  {
+    trace_emit(EV_SWITCH, current_pid, 0, next_pid);
+  }
+  loadProc(next_pid);
+}
+
+// This function runs the periodic work of run(): the working-set sampler and the quantum timer.
+void vm_tick()
+{
+  if (icount >= wss_next_sample)
+  {
+    wss_sample();
+  }
+  if (icount >= slice_end && running)
+  {
+    preempt();
+  }
+  next_tick = slice_end < wss_next_sample ? slice_end : wss_next_sample;
+}
+
 // YOUR CODE ENDS HERE
@@ -1,5 +1,9 @@
 #include "vm.c"
 
+#ifndef PHYS_MEM_SIZE
+#define PHYS_MEM_SIZE UINT16_MAX
+#endif
+
 int main(int argc, char **argv) {
     initOS();
     for (int i = 1; i < argc; i += 2) {
@@ -7,7 +11,7 @@ int main(int argc, char **argv) {
     }
 
     fprintf(stdout, "Occupied memory after program load:\n");
-    fprintf_mem_nonzero(stdout, mem, UINT16_MAX);
+    dump_mem_nonzero(stdout, mem, PHYS_MEM_SIZE, "load");
     uint16_t currentProc = 0;
     loadProc(currentProc);
     fprintf_reg_all(stdout, reg, RCNT);
@@ -15,7 +19,7 @@ int main(int argc, char **argv) {
     run(argv[1], argv[2]);
     fprintf(stdout, "program execution ends.\n");
     fprintf(stdout, "Occupied memory after program execution:\n");
-    fprintf_mem_nonzero(stdout, mem, UINT16_MAX);   
+    dump_mem_nonzero(stdout, mem, PHYS_MEM_SIZE, "exit");
     fprintf_reg_all(stdout, reg, RCNT);
     return 0;
 }
\ No newline at end of file
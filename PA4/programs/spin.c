@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+A CPU-bound program for the scheduler: count down from the number stored at x4000
+without ever yielding, then halt. It runs about 10000 instructions.
+*/
+
+uint16_t program[] = {
+    /*mem[0x3000]=*/   0x2404,    //  0010 0100 0000 0100             LD R2,x4        ;load the heap address stored at x3005
+    /*mem[0x3001]=*/   0x6880,    //  0110 1000 1000 0000             LDR R4,R2,x0    ;load the counter
+    /*mem[0x3002]=*/   0x193F,    //  0001 1001 0011 1111     LOOP    ADD R4,R4,x-1   ;decrement the counter
+    /*mem[0x3003]=*/   0x03FE,    //  0000 0011 1111 1110             BRp LOOP        ;do it again if the counter is not yet zero
+    /*mem[0x3004]=*/   0xF025,    //  1111 0000 0010 0101             HALT            ;halt
+    /*mem[0x3005]=*/   0x4000,    //  0100 0000 0000 0000             HEAP Beginning Address
+};
+uint16_t heap[] = {
+    /* --memory-- */
+    /*mem[0x4000]=*/   0x1388, /* 5000 iterations */
+};
+
+int main(int argc, char** argv) {
+    char *outf = "programs/spin_code.obj";
+    FILE *f = fopen(outf, "wb");
+    if (NULL==f) {
+        fprintf(stderr, "Cannot write to file %s\n", outf);
+    }
+    size_t writ = fwrite(program, sizeof(uint16_t), sizeof(program)/sizeof(uint16_t), f);
+    fprintf(stdout, "Written size_t=%lu to file %s\n", writ, outf);
+    fclose(f);
+
+
+    char *outff = "programs/spin_heap.obj";
+    FILE *ff = fopen(outff, "wb");
+    if (NULL==ff) {
+        fprintf(stderr, "Cannot write to file %s\n", outff);
+    }
+    writ = fwrite(heap, sizeof(uint16_t), sizeof(heap)/sizeof(uint16_t), ff);
+    fprintf(stdout, "Written size_t=%lu to file %s\n", writ, outff);
+    fclose(ff);
+    return 0;
+}
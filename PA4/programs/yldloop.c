@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+An interactive program for the scheduler: yield once per iteration, 20 times, then halt.
+Registers are shared between processes across a YIELD, so the counter lives in the heap
+and is reloaded through the pointer at x3007 after every yield.
+*/
+
+uint16_t program[] = {
+    /*mem[0x3000]=*/   0xA806,    //  1010 1000 0000 0110     LOOP    LDI R4,x6       ;load the counter from the heap
+    /*mem[0x3001]=*/   0x0404,    //  0000 0100 0000 0100             BRz DONE        ;stop when it reaches zero
+    /*mem[0x3002]=*/   0x193F,    //  0001 1001 0011 1111             ADD R4,R4,x-1   ;decrement the counter
+    /*mem[0x3003]=*/   0xB803,    //  1011 1000 0000 0011             STI R4,x3       ;store it back to the heap
+    /*mem[0x3004]=*/   0xF028,    //  1111 0000 0010 1000             YIELD           ;yield to another process
+    /*mem[0x3005]=*/   0x0FFA,    //  0000 1111 1111 1010             BRnzp LOOP      ;next iteration
+    /*mem[0x3006]=*/   0xF025,    //  1111 0000 0010 0101     DONE    HALT            ;halt
+    /*mem[0x3007]=*/   0x4000,    //  0100 0000 0000 0000             HEAP Beginning Address
+};
+uint16_t heap[] = {
+    /* --memory-- */
+    /*mem[0x4000]=*/   0x0014, /* 20 iterations */
+};
+
+int main(int argc, char** argv) {
+    char *outf = "programs/yldloop_code.obj";
+    FILE *f = fopen(outf, "wb");
+    if (NULL==f) {
+        fprintf(stderr, "Cannot write to file %s\n", outf);
+    }
+    size_t writ = fwrite(program, sizeof(uint16_t), sizeof(program)/sizeof(uint16_t), f);
+    fprintf(stdout, "Written size_t=%lu to file %s\n", writ, outf);
+    fclose(f);
+
+
+    char *outff = "programs/yldloop_heap.obj";
+    FILE *ff = fopen(outff, "wb");
+    if (NULL==ff) {
+        fprintf(stderr, "Cannot write to file %s\n", outff);
+    }
+    writ = fwrite(heap, sizeof(uint16_t), sizeof(heap)/sizeof(uint16_t), ff);
+    fprintf(stdout, "Written size_t=%lu to file %s\n", writ, outff);
+    fclose(ff);
+    return 0;
+}
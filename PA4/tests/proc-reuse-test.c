@@ -0,0 +1,19 @@
+#include "../MyCode/vm.c" // Built against the code it tests, see the tests target
+
+int main(int argc, char **argv) {
+    initOS();
+    int created = 0;
+    for (int round = 0; round < 5000; round++) {
+        for (int p = 0; p < 3; p++) {
+            created += createProc("programs/simple_code.obj", "programs/simple_heap.obj");
+        }
+        for (int p = 2; p >= 0; p--) { // halt in reverse order so slots are freed out of order
+            loadProc(p);
+            thalt();
+        }
+    }
+    fprintf(stdout, "created=%d proc_count=%d status=%d\n", created, mem[Proc_Count], mem[OS_STATUS]);
+    fprintf(stdout, "Occupied memory after all processes halted:\n");
+    fprintf_mem_nonzero(stdout, mem, 4096);
+    return 0;
+}
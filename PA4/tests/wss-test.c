@@ -0,0 +1,17 @@
+#include "../MyCode/vm.c" // Built against the code it tests, see the tests target
+
+int main(int argc, char **argv) {
+    initOS();
+    createProc("programs/simple_code.obj", "programs/simple_heap.obj");
+    loadProc(0);
+    mw(0x4000, 42); // touches heap page 8 and marks it dirty
+    mr(0x3000);     // touches code page 6
+    fprintf(stdout, "pte[6]=0x%.04x pte[8]=0x%.04x pte[9]=0x%.04x\n", mem[reg[PTBR] + 6], mem[reg[PTBR] + 8], mem[reg[PTBR] + 9]);
+    wss_sample();
+    fprintf(stdout, "pte[6]=0x%.04x pte[8]=0x%.04x\n", mem[reg[PTBR] + 6], mem[reg[PTBR] + 8]);
+    reg[R0] = 0xFFFF;
+    twss();
+    fprintf(stdout, "wss=%d resident=%d\n", reg[R0], reg[R1]);
+    fprintf_wss_report(stdout);
+    return 0;
+}
@@ -1,3 +1,13 @@
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define MEM_DUMP_BUF_SIZE (1 << 20) // fprintf_mem_nonzero output is flushed once this fills up
+#define MEM_DUMP_LINE_MAX (96)      // longest line fprintf_mem_nonzero can produce
+#define MEM_DUMP_MAGIC (0x504d4456) // "VDMP" in little endian
+#define MEM_DUMP_MERGE_GAP (8)      // zero runs shorter than this do not split a binary dump span
+
 // DEBUG
 void fprintf_binary(FILE *f, uint16_t num) {
     int c = 16;
@@ -23,15 +33,185 @@ void fprintf_mem(FILE *f, uint16_t *mem, uint16_t from, uint16_t to) {
     }
 }
 
+// Returns the index of the first nonzero word in mem[i, stop), or stop.
+// Zero runs are skipped 16 words per step with SSE2, 4 words per step otherwise.
+static inline uint32_t skip_zero_words(uint16_t *mem, uint32_t i, uint32_t stop) {
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    while (i + 16 <= stop) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(mem + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(mem + i + 8));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(a, b), zero)) != 0xFFFF) {
+            break;
+        }
+        i += 16;
+    }
+#endif
+    while (i + 4 <= stop) {
+        uint64_t w;
+        memcpy(&w, mem + i, sizeof(w));
+        if (w != 0) {
+            break;
+        }
+        i += 4;
+    }
+    while (i < stop && mem[i] == 0) {
+        i++;
+    }
+    return i;
+}
+
+// Appends the decimal digits of num to p, returns the new end.
+static inline char *put_dec(char *p, uint32_t num) {
+    char tmp[10];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + num % 10;
+        num /= 10;
+    } while (num);
+    while (n) {
+        *p++ = tmp[--n];
+    }
+    return p;
+}
+
+// Appends num as lowercase hex with at least 4 digits, like "%.04x".
+static inline char *put_hex(char *p, uint32_t num) {
+    static const char digits[] = "0123456789abcdef";
+    int n = 4;
+    while (n < 8 && (num >> (4 * n))) {
+        n++;
+    }
+    while (n--) {
+        *p++ = digits[(num >> (4 * n)) & 0xF];
+    }
+    return p;
+}
+
+// Appends " dddd dddd dddd dddd", the fprintf_binary format of num.
+static inline char *put_binary(char *p, uint16_t num) {
+    for (int nibble = 3; nibble >= 0; nibble--) {
+        *p++ = ' ';
+        for (int bit = 3; bit >= 0; bit--) {
+            *p++ = '0' + ((num >> (nibble * 4 + bit)) & 1);
+        }
+    }
+    return p;
+}
+
+// Same output as printing every nonzero word with fprintf_binary, but zero runs are skipped
+// a vector at a time and the lines are formatted into one buffer that is written in one go.
+// Without a buffer it falls back to printing word by word.
 void fprintf_mem_nonzero(FILE *f, uint16_t *mem, uint32_t stop) {
-    for(int i = 0; i < stop; i++) {
-        if (mem[i]!=0) {
+    size_t cap = MEM_DUMP_BUF_SIZE;
+    char *buf = malloc(cap);
+    char *p = buf;
+    if (buf == NULL) {
+        for (uint32_t i = skip_zero_words(mem, 0, stop); i < stop; i = skip_zero_words(mem, i + 1, stop)) {
             fprintf(f, "mem[%d|0x%.04x]=", i, i);
             fprintf_binary(f, mem[i]);
-            fprintf (f," (dec: %d)", mem[i]);
-            fprintf(f, "\n"); 
+            fprintf(f, " (dec: %d)", mem[i]);
+            fprintf(f, "\n");
+        }
+        return;
+    }
+
+    for (uint32_t i = skip_zero_words(mem, 0, stop); i < stop; i = skip_zero_words(mem, i + 1, stop)) {
+        if ((size_t)(p - buf) > cap - MEM_DUMP_LINE_MAX) {
+            fwrite(buf, 1, p - buf, f);
+            p = buf;
         }
+        memcpy(p, "mem[", 4);
+        p = put_dec(p + 4, i);
+        memcpy(p, "|0x", 3);
+        p = put_hex(p + 3, i);
+        *p++ = ']';
+        *p++ = '=';
+        p = put_binary(p, mem[i]);
+        memcpy(p, " (dec: ", 7);
+        p = put_dec(p + 7, mem[i]);
+        *p++ = ')';
+        *p++ = '\n';
+    }
+
+    fwrite(buf, 1, p - buf, f);
+    free(buf);
+}
+
+// Binary dump: a header {magic, words} followed by spans {start, length, words[length]}
+// covering the nonzero memory, terminated by a span of length 0.
+void fwrite_mem_dump(FILE *f, uint16_t *mem, uint32_t stop) {
+    uint32_t hdr[2] = {MEM_DUMP_MAGIC, stop};
+    fwrite(hdr, sizeof(uint32_t), 2, f);
+
+    uint32_t i = skip_zero_words(mem, 0, stop);
+    while (i < stop) {
+        uint32_t end = i + 1;
+        // extend the span over short zero gaps
+        while (end < stop) {
+            uint32_t next = skip_zero_words(mem, end, stop);
+            if (next == stop || next - end >= MEM_DUMP_MERGE_GAP) {
+                break;
+            }
+            end = next + 1;
+        }
+        uint32_t span[2] = {i, end - i};
+        fwrite(span, sizeof(uint32_t), 2, f);
+        fwrite(mem + i, sizeof(uint16_t), end - i, f);
+        i = skip_zero_words(mem, end, stop);
+    }
+
+    uint32_t last[2] = {stop, 0};
+    fwrite(last, sizeof(uint32_t), 2, f);
+}
+
+// Reads a binary dump into a newly allocated array. Returns NULL if f is not a dump,
+// including one cut off before its terminating span.
+uint16_t *fread_mem_dump(FILE *f, uint32_t *stop) {
+    uint32_t hdr[2];
+    if (fread(hdr, sizeof(uint32_t), 2, f) != 2 || hdr[0] != MEM_DUMP_MAGIC) {
+        return NULL;
+    }
+    uint16_t *mem = calloc(hdr[1] ? hdr[1] : 1, sizeof(uint16_t));
+    if (mem == NULL) {
+        return NULL;
+    }
+    uint32_t span[2];
+    for (;;) {
+        if (fread(span, sizeof(uint32_t), 2, f) != 2) { // truncated, no terminator
+            free(mem);
+            return NULL;
+        }
+        if (span[1] == 0) {
+            break;
+        }
+        if (span[0] > hdr[1] || span[1] > hdr[1] - span[0] ||
+            fread(mem + span[0], sizeof(uint16_t), span[1], f) != span[1]) {
+            free(mem);
+            return NULL;
+        }
+    }
+    *stop = hdr[1];
+    return mem;
+}
+
+// Prints the nonzero memory, or writes it as a binary dump to <VM_DUMP_BIN>-<tag>.bin when
+// that environment variable is set, so regression runs skip the text formatting.
+void dump_mem_nonzero(FILE *f, uint16_t *mem, uint32_t stop, const char *tag) {
+    const char *prefix = getenv("VM_DUMP_BIN");
+    if (prefix == NULL) {
+        fprintf_mem_nonzero(f, mem, stop);
+        return;
+    }
+    char path[4096];
+    snprintf(path, sizeof(path), "%s-%s.bin", prefix, tag);
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot open file %s.\n", path);
+        return;
     }
+    fwrite_mem_dump(out, mem, stop);
+    fclose(out);
 }
 
 void fprintf_reg(FILE *f, uint16_t *reg, int idx) {
@@ -7,5 +7,8 @@ void fprintf_binary(FILE *f, uint16_t num);
 void fprintf_inst(FILE *f, uint16_t instr);
 void fprintf_mem(FILE *f, uint16_t *mem, uint16_t from, uint16_t to);
 void fprintf_mem_nonzero(FILE *f, uint16_t *mem, uint32_t stop);
+void fwrite_mem_dump(FILE *f, uint16_t *mem, uint32_t stop);
+uint16_t *fread_mem_dump(FILE *f, uint32_t *stop);
+void dump_mem_nonzero(FILE *f, uint16_t *mem, uint32_t stop, const char *tag);
 void fprintf_reg(FILE *f, uint16_t *reg, int idx);
 void fprintf_reg_all(FILE *f, uint16_t *reg, int size);
\ No newline at end of file
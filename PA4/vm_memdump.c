@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vm_dbg.h"
+
+// Offline viewer for the binary memory dumps written by dump_mem_nonzero when VM_DUMP_BIN is set.
+// Usage: ./vm_memdump <dump>            prints it like fprintf_mem_nonzero
+//        ./vm_memdump -d <dump> <dump>  prints the words that differ, exits with 1 if any do
+
+uint16_t *load_dump(char *fname, uint32_t *stop) {
+    FILE *in = fopen(fname, "rb");
+    if (NULL == in) {
+        fprintf(stderr, "Cannot open file %s.\n", fname);
+        exit(2);
+    }
+    uint16_t *mem = fread_mem_dump(in, stop);
+    fclose(in);
+    if (NULL == mem) {
+        fprintf(stderr, "%s is not a memory dump.\n", fname);
+        exit(2);
+    }
+    return mem;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 2) {
+        uint32_t stop;
+        uint16_t *mem = load_dump(argv[1], &stop);
+        fprintf_mem_nonzero(stdout, mem, stop);
+        free(mem);
+        return 0;
+    }
+
+    if (argc != 4 || strcmp(argv[1], "-d") != 0) {
+        fprintf(stderr, "Incorrect call, usage: %s <dump> | -d <dump> <dump>\n", argv[0]);
+        return 2;
+    }
+
+    uint32_t stop_a, stop_b;
+    uint16_t *a = load_dump(argv[2], &stop_a);
+    uint16_t *b = load_dump(argv[3], &stop_b);
+    uint32_t stop = stop_a > stop_b ? stop_a : stop_b;
+    int differ = 0;
+    for (uint32_t i = 0; i < stop; i++) {
+        uint16_t va = i < stop_a ? a[i] : 0;
+        uint16_t vb = i < stop_b ? b[i] : 0;
+        if (va != vb) {
+            fprintf(stdout, "mem[%u|0x%.04x]: %u -> %u\n", i, i, va, vb);
+            differ = 1;
+        }
+    }
+    free(a);
+    free(b);
+    return differ;
+}
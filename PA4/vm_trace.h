@@ -0,0 +1,134 @@
+// baris.pome - CS307 - PA4 - 31311
+// Binary event trace shared by the VM and the offline decoder (vm_trace_decode.c)
+
+#ifndef VM_TRACE_H
+#define VM_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Set to 0 at compile time (-DVM_TRACE=0) to drop the ring buffer and print events directly
+#ifndef VM_TRACE
+#define VM_TRACE (1)
+#endif
+
+#define TRACE_RING_SIZE (1 << 14) // Number of records in the ring buffer, must be a power of two
+#define TRACE_MAGIC (0x43525456)  // "VTRC" in little endian
+#define TRACE_VERSION (1)
+
+// Event types. The text each one decodes to is the message the OS printed before the trace existed.
+enum trace_event
+{
+  EV_NONE = 0,
+  EV_SWITCH,           // pid switched to the process in the frame field
+  EV_HEAP_INC,         // heap increase requested
+  EV_HEAP_INC_DUP,     // heap increase of an already allocated vpn
+  EV_HEAP_INC_NOMEM,   // heap increase failed, no free frames
+  EV_HEAP_DEC,         // heap decrease requested
+  EV_HEAP_DEC_UNALLOC, // heap decrease of an unallocated vpn
+  EV_SEGFAULT,         // access below the heap/code boundary
+  EV_SEGFAULT_FREE,    // access to an invalid page
+  EV_READ_WO,          // read from a write-only page
+  EV_WRITE_RO,         // write to a read-only page
+  EV_PCB_FULL,         // createProc found the PCB list full
+  EV_CODE_NOMEM,       // createProc could not allocate the code segment
+  EV_HEAP_NOMEM,       // createProc could not allocate the heap segment
+  EV_PT_NOMEM,         // createProc could not allocate a page table frame
+  EV_COUNT
+};
+
+// Fixed-size trace record. icount is the number of instructions executed when the event was emitted.
+typedef struct trace_rec
+{
+  uint64_t icount;
+  uint16_t type;
+  uint16_t pid;
+  uint16_t vpn;
+  uint16_t frame;
+} trace_rec;
+
+// File header written in front of the records
+typedef struct trace_hdr
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t rec_size;
+  uint64_t icount; // instructions executed when the trace was closed
+  uint64_t events; // number of events emitted, including ones lost to ring wrap-around
+} trace_hdr;
+
+// This function prints a record exactly the way the OS used to print the event.
+static inline void trace_fprint(FILE *f, const trace_rec *r)
+{
+  switch (r->type)
+  {
+  case EV_SWITCH:
+    fprintf(f, "We are switching from process %d to %d.\n", r->pid, r->frame);
+    break;
+  case EV_HEAP_INC:
+    fprintf(f, "Heap increase requested by process %d.\n", r->pid);
+    break;
+  case EV_HEAP_INC_DUP:
+    fprintf(f, "Cannot allocate memory for page %d of pid %d since it is already allocated.\n", r->vpn, r->pid);
+    break;
+  case EV_HEAP_INC_NOMEM:
+    fprintf(f, "Cannot allocate more space for pid %d since there is no free page frames.\n", r->pid);
+    break;
+  case EV_HEAP_DEC:
+    fprintf(f, "Heap decrease requested by process %d.\n", r->pid);
+    break;
+  case EV_HEAP_DEC_UNALLOC:
+    fprintf(f, "Cannot free memory of page %d of pid %d since it is not allocated.\n", r->vpn, r->pid);
+    break;
+  case EV_SEGFAULT:
+    fprintf(f, "Segmentation fault.\n");
+    break;
+  case EV_SEGFAULT_FREE:
+    fprintf(f, "Segmentation fault inside free space.\n");
+    break;
+  case EV_READ_WO:
+    fprintf(f, "Cannot read from a write-only page.\n");
+    break;
+  case EV_WRITE_RO:
+    fprintf(f, "Cannot write to a read-only page.\n");
+    break;
+  case EV_PCB_FULL:
+    fprintf(f, "The OS memory region is full. Cannot create a new PCB.\n");
+    break;
+  case EV_CODE_NOMEM:
+    fprintf(f, "Cannot create code segment.\n");
+    break;
+  case EV_HEAP_NOMEM:
+    fprintf(f, "Failed to allocate memory for the heap segment.\n");
+    break;
+  case EV_PT_NOMEM:
+    fprintf(f, "Cannot allocate a page table for pid %d.\n", r->pid);
+    break;
+  default:
+    fprintf(f, "Unknown trace event %d.\n", r->type);
+    break;
+  }
+}
+
+// This function prints event counts together with the switch and fault rates per 1000 instructions.
+static inline void trace_fprint_summary(FILE *f, const uint64_t *counts, uint64_t icount)
+{
+  uint64_t faults = counts[EV_SEGFAULT] + counts[EV_SEGFAULT_FREE] + counts[EV_READ_WO] + counts[EV_WRITE_RO];
+  uint64_t alloc_failures =
+      counts[EV_HEAP_INC_NOMEM] + counts[EV_CODE_NOMEM] + counts[EV_HEAP_NOMEM] + counts[EV_PT_NOMEM];
+  double kilo = icount ? icount / 1000.0 : 1.0;
+
+  fprintf(f, "instructions: %llu\n", (unsigned long long)icount);
+  fprintf(f, "context switches: %llu (%.3f per 1k instructions)\n",
+          (unsigned long long)counts[EV_SWITCH], counts[EV_SWITCH] / kilo);
+  fprintf(f, "heap increases: %llu, heap decreases: %llu\n",
+          (unsigned long long)counts[EV_HEAP_INC], (unsigned long long)counts[EV_HEAP_DEC]);
+  fprintf(f, "allocation failures: %llu\n", (unsigned long long)alloc_failures);
+  fprintf(f, "faults: %llu (%.3f per 1k instructions)\n", (unsigned long long)faults, faults / kilo);
+  if (counts[EV_SWITCH])
+  {
+    fprintf(f, "mean instructions between switches: %.1f\n", (double)icount / counts[EV_SWITCH]);
+  }
+}
+
+#endif
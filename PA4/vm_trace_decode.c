@@ -0,0 +1,75 @@
+// baris.pome - CS307 - PA4 - 31311
+// Offline decoder for the binary traces written when VM_TRACE_OUT is set.
+// Usage: ./vm_trace_decode [-s] [-t] <trace file>
+//   -s  print only the summary of switch and fault rates
+//   -t  prefix every event with its instruction count
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm_trace.h"
+
+int main(int argc, char **argv)
+{
+  int summary_only = 0;
+  int timestamps = 0;
+  char *fname = NULL;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-s") == 0)
+      summary_only = 1;
+    else if (strcmp(argv[i], "-t") == 0)
+      timestamps = 1;
+    else
+      fname = argv[i];
+  }
+
+  if (fname == NULL)
+  {
+    fprintf(stderr, "Incorrect call, usage: %s [-s] [-t] <trace file>\n", argv[0]);
+    return 1;
+  }
+
+  FILE *in = fopen(fname, "rb");
+  if (NULL == in)
+  {
+    fprintf(stderr, "Cannot open file %s.\n", fname);
+    return 1;
+  }
+
+  trace_hdr hdr;
+  if (fread(&hdr, sizeof(hdr), 1, in) != 1 || hdr.magic != TRACE_MAGIC ||
+      hdr.version != TRACE_VERSION || hdr.rec_size != sizeof(trace_rec))
+  {
+    fprintf(stderr, "%s is not a VM trace file.\n", fname);
+    fclose(in);
+    return 1;
+  }
+
+  uint64_t counts[EV_COUNT] = {0};
+  uint64_t decoded = 0;
+  trace_rec rec;
+  while (fread(&rec, sizeof(rec), 1, in) == 1)
+  {
+    if (rec.type < EV_COUNT)
+      counts[rec.type]++;
+    decoded++;
+    if (summary_only)
+      continue;
+    if (timestamps)
+      fprintf(stdout, "[%llu] ", (unsigned long long)rec.icount);
+    trace_fprint(stdout, &rec);
+  }
+  fclose(in);
+
+  if (summary_only)
+  {
+    // An unclosed trace (the VM was killed) has no final instruction count, use the last record's
+    uint64_t icount = hdr.icount ? hdr.icount : rec.icount;
+    trace_fprint_summary(stdout, counts, icount);
+    if (hdr.events > decoded)
+      fprintf(stdout, "events lost to ring wrap-around: %llu\n", (unsigned long long)(hdr.events - decoded));
+  }
+  return 0;
+}